@@ -0,0 +1,168 @@
+// MapsParser against the two maps parsers it replaced, on a synthetic maps file.
+//
+//   maps_parser_bench [lines] [loads]
+//
+// Each parser reads and parses the whole file on every load and builds the page list its
+// caller used to get. Region counts are compared so a parser that skips lines shows up.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include <unistd.h>
+
+#include "maps_parser.h"
+
+struct Page
+{
+    Page(uintptr_t s, uintptr_t e, char r, char w, char x, char c, uint64_t offset, const std::string &name) :
+        start(s), end(e), read(r), write(w), exec(x), cow(c), offset(offset), name(name)
+    {
+    }
+
+    uintptr_t start, end;
+    char read, write, exec, cow;
+    uint64_t offset;
+    std::string name;
+};
+
+// The client's ProcUtil::GetPages before MapsParser
+static std::vector<Page> getline_sscanf(const char *path)
+{
+    std::vector<Page> pages;
+
+    if (std::ifstream fi { path })
+    {
+        std::string line, filename;
+        uintptr_t start, end;
+        char read, write, exec, cow;
+        uint32_t offset, dev_major, dev_minor, inode;
+
+        while (std::getline(fi, line))
+        {
+            filename.resize(line.size());
+            int fields = sscanf(line.c_str(), "%lx-%lx %c%c%c%c %x %x:%x %u %[^\n]",
+                &start, &end, &read, &write, &exec, &cow, &offset, &dev_major, &dev_minor, &inode, &filename[0]);
+            if (fields >= 6)
+            {
+                pages.emplace_back(start, end, read, write, exec, cow, offset, fields == 11 ? filename.c_str() : "");
+            }
+        }
+    }
+    return pages;
+}
+
+// do_lib's memory::get_pages before MapsParser
+static std::vector<Page> stringstream_per_line(const char *path)
+{
+    std::vector<Page> pages;
+
+    if (std::ifstream maps_f { path })
+    {
+        std::string line;
+        while (std::getline(maps_f, line))
+        {
+            std::stringstream ss(line);
+
+            uintptr_t start, end, offset, dev_major, dev_minor, inode;
+            char skip, r, w, x, c;
+            std::string path_name;
+
+            ss >> std::hex >> start >> skip >> end >> r >> w >> x >> c >>
+                offset >> dev_major >> skip >> dev_minor >> inode >> path_name;
+
+            pages.emplace_back(start, end, r, w, x, c, offset, path_name);
+        }
+    }
+    return pages;
+}
+
+static size_t maps_parser_views(MapsParser &parser, const char *path)
+{
+    return parser.LoadFile(path) ? parser.Regions().size() : 0;
+}
+
+// What ProcUtil::GetPages and memory::get_pages do now
+static std::vector<Page> maps_parser_pages(MapsParser &parser, const char *path)
+{
+    std::vector<Page> pages;
+    if (parser.LoadFile(path))
+    {
+        for (auto &region : parser.Regions())
+        {
+            pages.emplace_back(region.start, region.end, region.read, region.write, region.exec, region.cow,
+                    region.offset, std::string(region.name));
+        }
+    }
+    return pages;
+}
+
+// Looks like flash's maps: mostly anonymous heap, plus mapped libraries with long paths
+static void write_maps(const char *path, int lines)
+{
+    FILE *f = fopen(path, "w");
+    uintptr_t address = 0x7f0000000000;
+
+    for (int i = 0; i < lines; i++)
+    {
+        uintptr_t size = 0x1000 * (1 + (i * 7919) % 64);
+        const char *perms = i % 5 == 0 ? "r-xp" : i % 5 == 1 ? "r--p" : "rw-p";
+
+        if (i % 3 == 0)
+        {
+            fprintf(f, "%lx-%lx %s %08x fd:01 %d                      /usr/lib/x86_64-linux-gnu/libsomething-%d.so.1\n",
+                    address, address + size, perms, (i % 16) * 0x1000, 1000000 + i, i % 97);
+        }
+        else
+        {
+            fprintf(f, "%lx-%lx %s 00000000 00:00 0 \n", address, address + size, perms);
+        }
+        address += size + 0x1000;
+    }
+    fclose(f);
+}
+
+template <typename F>
+static double time_loads(int loads, size_t &regions, F &&load)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < loads; i++)
+    {
+        regions = load();
+    }
+    return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count() / loads;
+}
+
+int main(int argc, char **argv)
+{
+    int lines = argc > 1 ? atoi(argv[1]) : 5000;
+    int loads = argc > 2 ? atoi(argv[2]) : 200;
+
+    char path[] = "/tmp/maps_bench_XXXXXX";
+    close(mkstemp(path));
+    write_maps(path, lines);
+
+    MapsParser parser;
+    size_t regions = 0;
+
+    printf("%d lines, mean of %d loads\n", lines, loads);
+
+    double us = time_loads(loads, regions, [&] { return getline_sscanf(path).size(); });
+    printf("  old client getline + sscanf   %8.0f us  %zu regions\n", us, regions);
+
+    us = time_loads(loads, regions, [&] { return stringstream_per_line(path).size(); });
+    printf("  old do_lib stringstream       %8.0f us  %zu regions\n", us, regions);
+
+    us = time_loads(loads, regions, [&] { return maps_parser_views(parser, path); });
+    printf("  MapsParser, views only        %8.0f us  %zu regions\n", us, regions);
+
+    us = time_loads(loads, regions, [&] { return maps_parser_pages(parser, path).size(); });
+    printf("  MapsParser + page copies      %8.0f us  %zu regions\n", us, regions);
+
+    unlink(path);
+    return 0;
+}
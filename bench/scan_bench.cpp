@@ -0,0 +1,117 @@
+// In-process scan (memory::query_memory, what do_lib runs for SCAN) against the client's
+// cross-process scan (ProcUtil::QueryMemory) over the same heap.
+//
+//   scan_bench [MiB] [runs]
+//
+// A child process holds the buffer and runs the in-process scan on itself, the parent scans the
+// child from outside. Both are timed around the scan only, maps parsing included.
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "compiled_pattern.h"
+#include "memory.h"
+#include "proc_util.h"
+
+static const uint8_t query[] = { 0x4c, 0x8b, 0x05, 0x00, 0x00, 0x00, 0x00, 0x48 };
+static const char mask[] = "xxx????x";
+
+static double since_ms(std::chrono::steady_clock::time_point start)
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv)
+{
+    size_t mib = argc > 1 ? atoi(argv[1]) : 512;
+    int runs = argc > 2 ? atoi(argv[2]) : 5;
+    size_t size = mib << 20;
+
+    CompiledPattern pattern(query, mask, sizeof(query));
+
+    int to_parent[2], to_child[2];
+    if (pipe(to_parent) || pipe(to_child))
+    {
+        perror("pipe");
+        return 1;
+    }
+
+    pid_t child = fork();
+    if (child == 0)
+    {
+        close(to_child[1]);
+        close(to_parent[0]);
+
+        auto *heap = static_cast<uint8_t *>(mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0));
+        for (size_t i = 0; i < size; i++)
+        {
+            heap[i] = static_cast<uint8_t>(i * 2654435761u >> 13);
+        }
+        // One hit every 64 KiB
+        for (size_t i = 0; i + sizeof(query) <= size; i += 64 * 1024)
+        {
+            memcpy(heap + i, query, sizeof(query));
+        }
+
+        // Shared like do_lib's result buffer, so it doesn't merge with the heap mapping it would skip
+        size_t max = 1 << 20;
+        auto *out = static_cast<uintptr_t *>(mmap(nullptr, max * sizeof(uintptr_t), PROT_READ | PROT_WRITE,
+                MAP_SHARED | MAP_ANONYMOUS, -1, 0));
+
+        char go;
+        while (read(to_child[0], &go, 1) == 1)
+        {
+            auto start = std::chrono::steady_clock::now();
+            size_t found = memory::query_memory(pattern, 1, out, max);
+            double ms = since_ms(start);
+
+            write(to_parent[1], &ms, sizeof(ms));
+            write(to_parent[1], &found, sizeof(found));
+        }
+        _exit(0);
+    }
+
+    close(to_child[0]);
+    close(to_parent[1]);
+
+    // Let the child fill its heap
+    char go = 1;
+    write(to_child[1], &go, 1);
+    double ms;
+    size_t found;
+    read(to_parent[0], &ms, sizeof(ms));
+    read(to_parent[0], &found, sizeof(found));
+
+    printf("%zu MiB heap, %d runs\n", mib, runs);
+
+    double in_process = 0, cross_process = 0;
+    size_t in_found = 0, cross_found = 0;
+    for (int i = 0; i < runs; i++)
+    {
+        write(to_child[1], &go, 1);
+        read(to_parent[0], &ms, sizeof(ms));
+        read(to_parent[0], &in_found, sizeof(in_found));
+        in_process += ms;
+
+        std::vector<uintptr_t> hits;
+        auto start = std::chrono::steady_clock::now();
+        ProcUtil::QueryMemory(child, pattern, hits, 1);
+        cross_process += since_ms(start);
+        cross_found = hits.size();
+    }
+
+    printf("in process     %8.1f ms  %zu hits\n", in_process / runs, in_found);
+    printf("cross process  %8.1f ms  %zu hits\n", cross_process / runs, cross_found);
+
+    close(to_child[1]);
+    waitpid(child, nullptr, 0);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "async_query.h"
+
+#include "proc_util.h"
+
+AsyncQuery::AsyncQuery(pid_t pid, const CompiledPattern &pattern, size_t limit, uint32_t alignment) :
+    m_pid(pid),
+    m_pattern(pattern),
+    m_limit(limit),
+    m_alignment(alignment ? alignment : 1),
+    m_thread(&AsyncQuery::runner, this)
+{
+}
+
+AsyncQuery::~AsyncQuery()
+{
+    Cancel();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void AsyncQuery::Poll(std::vector<uintptr_t> &out)
+{
+    std::scoped_lock lk { m_results_mut };
+    out.insert(out.end(), m_results.begin(), m_results.end());
+    m_results.clear();
+}
+
+double AsyncQuery::Progress() const
+{
+    uint64_t total = m_total;
+    if (!total)
+    {
+        return m_done ? 1.0 : 0.0;
+    }
+    return static_cast<double>(m_scanned) / total;
+}
+
+void AsyncQuery::Cancel()
+{
+    m_cancel = true;
+}
+
+void AsyncQuery::runner()
+{
+    size_t found = 0;
+
+    if (m_pattern.Valid())
+    {
+        auto regions = ProcUtil::GetScannablePages(m_pid);
+
+        uint64_t total = 0;
+        for (auto &region : regions)
+        {
+            total += region.end - region.start;
+        }
+        m_total = total;
+
+        std::vector<uintptr_t> chunk_results;
+
+        ProcUtil::ReadChunks(m_pid, regions, m_pattern.Size() - 1, [&] (const ProcUtil::MemChunk &chunk)
+        {
+            bool more = m_pattern.FindAll(chunk.data, chunk.size, m_alignment, [&] (size_t offset)
+            {
+                if (chunk.Seen(offset, m_pattern.Size()))
+                {
+                    return true;
+                }
+                chunk_results.push_back(chunk.address + offset);
+                return !m_limit || found + chunk_results.size() < m_limit;
+            });
+
+            if (!chunk_results.empty())
+            {
+                std::scoped_lock lk { m_results_mut };
+                m_results.insert(m_results.end(), chunk_results.begin(), chunk_results.end());
+                found += chunk_results.size();
+                chunk_results.clear();
+            }
+
+            m_scanned += chunk.advanced;
+            return more && !m_cancel;
+        });
+    }
+
+    m_done = true;
+}
@@ -0,0 +1,55 @@
+#ifndef ASYNC_QUERY_H
+#define ASYNC_QUERY_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "compiled_pattern.h"
+
+// Pattern scan running on its own thread. Results are handed out as they are found,
+// the scan can be cancelled at any chunk boundary and stops by itself if the process dies.
+class AsyncQuery
+{
+public:
+    // limit = 0 means no limit
+    AsyncQuery(pid_t pid, const CompiledPattern &pattern, size_t limit = 0, uint32_t alignment = 1);
+    ~AsyncQuery();
+
+    AsyncQuery(const AsyncQuery &) = delete;
+    AsyncQuery &operator=(const AsyncQuery &) = delete;
+
+    // Moves the results found since the last call into `out`
+    void Poll(std::vector<uintptr_t> &out);
+
+    // Bytes scanned / total bytes, stays below 1 if the scan was cancelled or hit the limit
+    double Progress() const;
+
+    inline bool Done() const { return m_done; }
+
+    void Cancel();
+
+private:
+    void runner();
+
+    pid_t m_pid;
+    CompiledPattern m_pattern;
+    size_t m_limit;
+    uint32_t m_alignment;
+
+    std::atomic<bool> m_cancel { false };
+    std::atomic<bool> m_done { false };
+    std::atomic<uint64_t> m_scanned { 0 };
+    std::atomic<uint64_t> m_total { 0 };
+
+    std::mutex m_results_mut;
+    std::vector<uintptr_t> m_results;
+
+    std::thread m_thread;
+};
+
+#endif /* ASYNC_QUERY_H */
@@ -1,4 +1,6 @@
 #include "bot_client.h"
+#include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <thread>
 #include <chrono>
@@ -7,121 +9,75 @@
 
 #include "utils.h"
 #include "proc_util.h"
+#include "protocol.h"
+#include "shm_ring.h"
 #include "sock_ipc.h"
 
 #include <signal.h>
 #include <sys/uio.h>
-#include <sys/ipc.h>
-#include <sys/shm.h>
-#include <sys/sem.h>
 #include <sys/wait.h>
 
 
-#define MEM_SIZE 1024
+// Addresses and entries come back after the fixed fields of the response
+#define MAX_SCAN_RESULTS ((SHM_ARENA_SIZE - sizeof(ScanMessage)) / sizeof(uintptr_t))
+#define MAX_INSTANCES ((SHM_ARENA_SIZE - sizeof(InstancesMessage)) / sizeof(uintptr_t))
 
+// In-process scans can take a while on a big heap
+#define SCAN_TIMEOUT_MS 30000
 
-enum class MessageType
-{
-    CALL,
-    RESULT,
-    SEND_NOTIFICATION,
-    REFINE,
-    UPGRADE,
-    USE_ITEM,
-    KEY_CLICK,
-    MOUSE_CLICK,
-    CHECK_SIGNATURE,
+// Async and batched commands are given up on after this, do_lib waits up to 5s on the game thread itself
+#define GAME_THREAD_TIMEOUT_MS 6000
 
-    NONE
-};
+// Finished tickets nobody took the result of are forgotten after this
+#define TICKET_EXPIRE_MS 60000
 
-struct RefineMessage
-{
-    MessageType type = MessageType::REFINE;
-    uintptr_t refine_util;
-    int ore, amount;
-};
+// Async commands in flight hold at most this many slots, the rest stay free for synchronous ones
+#define MAX_PENDING_COMMANDS (SHM_SLOTS - 2)
 
-struct SendNotificationMessage
-{
-    MessageType type = MessageType::SEND_NOTIFICATION;
-    char name[64];
-    uint32_t argc;
-    uintptr_t argv[64];
-};
 
-struct FunctionResultMessage
+struct BotClient::PendingCommand
 {
-    MessageType type = MessageType::RESULT;
-    bool error = false;
-    uintptr_t value;
+    std::shared_ptr<ShmRing> ring;      // keeps the segment attached until the ticket is gone
+    int slot;                   // -1 once the response was read or the command given up on
+    MessageType type;
+    CommandStatus status;
+    int64_t value;
+    std::chrono::steady_clock::time_point deadline;
+    std::chrono::steady_clock::time_point expires;
 };
 
-struct CallFunctionMessage
+// One BATCH frame, the commands are appended to it as they're added
+struct BotClient::CommandBatch
 {
-    MessageType type = MessageType::CALL;;
-    uintptr_t object;
-    uint32_t index;
-    int argc;
-    uintptr_t argv[64];
+    Frame message { MessageType::BATCH };
+    std::vector<size_t> offsets;    // of each command within the batch's tail
 };
 
-struct UseItemMessage
+// Status and value of a command from the response do_lib wrote over it
+static BotClient::CommandResult read_response(const MessageHeader *response)
 {
-    MessageType type = MessageType::USE_ITEM;
-    char name[64];
-    uint8_t action_type;
-    bool action_bar;
-
-    // ItemsControlMenuConstants.ACTION_SELECTION == 1
-    // ItemsControlMenuConstants.ACTION_TOOGLE == 0
-    // ItemsControlMenuConstants.ACTION_ONE_SHOT == 1
-    // barId = _loc2_.barId == CATEGORY_BAR ? 0 : 1;
-
-};
-
-struct KeyClickMessage
-{
-    MessageType type = MessageType::KEY_CLICK;
-    uint32_t key;
-};
-
-struct MouseClickMessage
-{
-    MessageType type = MessageType::MOUSE_CLICK;
-    uint32_t button;
-    int32_t x;
-    int32_t y;
-};
+    BotClient::CommandResult r { BotClient::CommandStatus::DONE, 0 };
 
-struct GetSignatureMessage
-{
-    MessageType type = MessageType::CHECK_SIGNATURE;;
-    uintptr_t object;
-    uint32_t index;
-    bool method_name;
-    char signature[0x100];
-
-    int32_t result;
-};
-
-union Message
-{
-    Message() { };
-    MessageType type = MessageType::NONE;;
-    CallFunctionMessage call;
-    FunctionResultMessage result;
-    SendNotificationMessage notify;
-    RefineMessage refine;
-    UseItemMessage item;
-    KeyClickMessage key;
-    MouseClickMessage click;
-    GetSignatureMessage sig;
-};
+    // Also what do_lib answers with when the game thread didn't get to a command in time
+    if (response->error)
+    {
+        r.status = BotClient::CommandStatus::FAILED;
+    }
+    else if (response->type == MessageType::RESULT)
+    {
+        r.value = reinterpret_cast<const FunctionResultMessage *>(response)->value;
+    }
+    else if (response->type == MessageType::CHECK_SIGNATURE)
+    {
+        r.value = reinterpret_cast<const CheckSignatureMessage *>(response)->result;
+    }
+    return r;
+}
 
 
 BotClient::BotClient() :
-    m_browser_ipc(new SockIpc())
+    m_browser_ipc(new SockIpc()),
+    m_flash(protocol_handshake())
 {
 }
 
@@ -141,6 +97,8 @@ void sigchld_handler(int signal)
 
 void BotClient::LaunchBrowser()
 {
+    std::scoped_lock lk { m_flash_mut };
+
     int pid = fork();
 
     switch (pid)
@@ -185,6 +143,8 @@ void BotClient::LaunchBrowser()
             signal(SIGCHLD, sigchld_handler);
 
             m_browser_pid = pid;
+            m_browser_tree.clear();
+            m_monitor.Watch(ProcessMonitor::BROWSER, pid);
             break;
         }
     }
@@ -192,7 +152,9 @@ void BotClient::LaunchBrowser()
 
 void BotClient::SendBrowserCommand(const std::string &&message, int sync)
 {
-    if (m_browser_pid > 0 && !ProcUtil::ProcessExists(m_browser_pid))
+    std::scoped_lock lk { m_flash_mut };
+
+    if (m_browser_pid > 0 && !m_monitor.Alive(ProcessMonitor::BROWSER))
     {
         fprintf(stderr, "[SendBrowserCommand] Browser process not found, restarting it\n");
         LaunchBrowser();
@@ -207,13 +169,13 @@ void BotClient::SendBrowserCommand(const std::string &&message, int sync)
             return;
         }
 
-        std::string ipc_path = utils::format("/tmp/darkbot_ipc_{}", m_browser_pid);
+        std::string ipc_path = utils::format("/tmp/darkbot_ipc_{}", m_browser_pid.load());
 
         //printf("[SendBrowserCommand] Connecting to %s\n", ipc_path.c_str());
 
         if (!m_browser_ipc->Connect(ipc_path))
         {
-            printf("[SendBrowserCommand] Failed to connect to browser %d\n", m_browser_pid);
+            printf("[SendBrowserCommand] Failed to connect to browser %d\n", m_browser_pid.load());
             return;
         }
     }
@@ -225,13 +187,60 @@ void BotClient::SendBrowserCommand(const std::string &&message, int sync)
 }
 
 bool BotClient::find_flash_process()
+{
+    if (m_browser_pid <= 0)
+    {
+        return false;
+    }
+
+    // The tree is only walked again once one of the processes we know of is gone,
+    // or when flash isn't in it yet
+    bool stale = m_browser_tree.empty() || std::any_of(m_browser_tree.begin(), m_browser_tree.end(), [] (pid_t pid)
+    {
+        return kill(pid, 0) == -1 && errno == ESRCH;
+    });
+
+    for (int attempt = 0; attempt < 2; attempt++)
+    {
+        if (stale)
+        {
+            m_browser_tree.clear();
+            if (!ProcUtil::GetDescendants(m_browser_pid, m_browser_tree))
+            {
+                m_browser_tree.clear();
+                return find_flash_process_slow();
+            }
+        }
+
+        for (pid_t pid : m_browser_tree)
+        {
+            if (ProcUtil::IsMapped(pid, "libpepflashplayer"))
+            {
+                m_flash_pid = pid;
+                m_monitor.Watch(ProcessMonitor::FLASH, pid);
+                return true;
+            }
+        }
+
+        if (stale)
+        {
+            break;
+        }
+        stale = true;
+    }
+    return false;
+}
+
+// Every process on the system, for kernels that don't list children in /proc
+bool BotClient::find_flash_process_slow()
 {
     auto procs = ProcUtil::FindProcsByName("no-sandbox");
     for (int proc_pid : procs)
     {
-        if (ProcUtil::IsChildOf(proc_pid, m_browser_pid) && ProcUtil::GetPages(proc_pid, "libpepflashplayer").size() > 0)
+        if (ProcUtil::IsChildOf(proc_pid, m_browser_pid) && ProcUtil::IsMapped(proc_pid, "libpepflashplayer"))
         {
             m_flash_pid = proc_pid;
+            m_monitor.Watch(ProcessMonitor::FLASH, proc_pid);
             return true;
         }
     }
@@ -241,21 +250,46 @@ bool BotClient::find_flash_process()
 void BotClient::reset()
 {
     // Reset
-    if (m_shared_mem_flash) shmdt(m_shared_mem_flash);
-    if (m_flash_sem >= 0) semctl(m_flash_sem, 0, IPC_RMID, 1);
-
+    {
+        std::scoped_lock lk { m_commands_mut };
+        m_commands.clear();
+    }
+    m_flash.Disconnect();
+    if (m_flash_pid > 0) ProcUtil::RegionTable::Forget(m_flash_pid);
 
-    m_shared_mem_flash = nullptr;
-    m_flash_pid = -1;
-    m_flash_sem = -1;
-    m_flash_shmid = -1;
+    m_monitor.Watch(ProcessMonitor::FLASH, -1);
     m_flash_pid = -1;
+
+    // Addresses are meaningless in a new flash process, the scan state goes on its next use
+    m_flash_generation++;
+}
+
+void BotClient::drop_stale_scans()
+{
+    if (m_scans_generation == m_flash_generation)
+    {
+        return;
+    }
+    m_scans_generation = m_flash_generation;
+
+    m_scan_sessions.clear();
+    m_incremental_queries.clear();
+    m_pointer_index.Clear();
+    m_async_queries.clear();
+}
+
+pid_t BotClient::flash_pid()
+{
+    std::scoped_lock lk { m_flash_mut };
+    return m_flash_pid > 0 || find_flash_process() ? m_flash_pid.load() : -1;
 }
 
 // Not a great name since it has side-effects like refreshgin or restarting the browser
 bool BotClient::IsValid()
 {
-    if (m_browser_pid > 0 && !ProcUtil::ProcessExists(m_browser_pid))
+    std::scoped_lock lk { m_flash_mut };
+
+    if (m_browser_pid > 0 && !m_monitor.Alive(ProcessMonitor::BROWSER))
     {
         fprintf(stderr, "[IsValid] Browser process not found, restarting it\n");
         LaunchBrowser();
@@ -268,9 +302,9 @@ bool BotClient::IsValid()
         return find_flash_process();
     }
 
-    if (!ProcUtil::ProcessExists(m_flash_pid))
+    if (!m_monitor.Alive(ProcessMonitor::FLASH))
     {
-        fprintf(stderr, "[IsValid] Flash process not found, trying to refresh %d, %d\n", m_flash_pid, m_browser_pid);
+        fprintf(stderr, "[IsValid] Flash process not found, trying to refresh %d, %d\n", m_flash_pid.load(), m_browser_pid.load());
         SendBrowserCommand("refresh", 1);
         reset();
         return false;
@@ -278,161 +312,946 @@ bool BotClient::IsValid()
     return true;
 }
 
-void BotClient::SendFlashCommand(Message *message, Message *response)
+bool BotClient::flash_supports(uint32_t capabilities)
+{
+    if (!IsValid() || !m_flash.Get(m_flash_pid))
+    {
+        return false;
+    }
+    if (!m_flash.Supports(capabilities))
+    {
+        fprintf(stderr, "[BotClient] do_lib doesn't support %x\n", capabilities);
+        return false;
+    }
+    return true;
+}
+
+bool BotClient::SendFlashCommand(const Frame &message, const ResponseReader &read, int timeout_ms)
 {
+    if (message.Size() > MAX_FRAME_SIZE)
+    {
+        return false;
+    }
+
     if (!IsValid())
     {
-        return;
+        return false;
+    }
+
+    auto ring = m_flash.Get(m_flash_pid);
+    if (!ring)
+    {
+        return false;
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    {
+        // Async commands keep their slot until their ticket is polled, hand back the finished ones
+        std::scoped_lock lk { m_commands_mut };
+        expire_commands();
+    }
+
+    int slot = ring->Acquire(deadline);
+    if (slot < 0)
+    {
+        fprintf(stderr, "[SendFlashCommand] Failed to send command to flash, %s\n", ring->Ready() ? "no free slot" : "ring closed");
+        return false;
+    }
+
+    auto &s = ring->At(slot);
+    memcpy(s.arena, message.Data(), message.Size());
+    ring->Submit(slot);
+
+    auto type = reinterpret_cast<const MessageHeader *>(message.Data())->type;
+    if (!ring->Wait(slot, deadline))
+    {
+        // A closed ring is dropped by the next m_flash.Get, which connects to do_lib's new one
+        fprintf(stderr, "[SendFlashCommand] Failed to send command to flash, %s\n", ring->Ready() ? "timeout" : "ring closed");
+        ring->Abandon(slot);
+        m_ipc_stats.RecordTimeout(type);
+        return false;
+    }
+
+    m_ipc_stats.Record(type, s.timing, ShmRing::Now(), reinterpret_cast<const MessageHeader *>(s.arena)->error);
+    if (read)
+    {
+        read(reinterpret_cast<const MessageHeader *>(s.arena));
     }
+    ring->Release(slot);
+    return true;
+}
 
+int BotClient::SendFlashCommandAsync(const Frame &message)
+{
+    if (message.Size() > MAX_FRAME_SIZE || !IsValid())
     {
-        if ((m_flash_shmid = shmget(m_flash_pid, MEM_SIZE, IPC_CREAT | 0666)) < 0)
+        return -1;
+    }
+
+    auto ring = m_flash.Get(m_flash_pid);
+    if (!ring)
+    {
+        return -1;
+    }
+
+    std::scoped_lock lk { m_commands_mut };
+
+    if (expire_commands() >= MAX_PENDING_COMMANDS)
+    {
+        fprintf(stderr, "[SendFlashCommandAsync] Too many commands in flight\n");
+        return -1;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    int slot = ring->Acquire(now);
+    if (slot < 0)
+    {
+        fprintf(stderr, "[SendFlashCommandAsync] No free slot\n");
+        return -1;
+    }
+
+    memcpy(ring->At(slot).arena, message.Data(), message.Size());
+    ring->Submit(slot);
+
+    int ticket = m_next_command++;
+    m_commands[ticket].reset(new PendingCommand {
+        ring, slot, reinterpret_cast<const MessageHeader *>(message.Data())->type, CommandStatus::PENDING, 0,
+        now + std::chrono::milliseconds(GAME_THREAD_TIMEOUT_MS),
+        now + std::chrono::milliseconds(TICKET_EXPIRE_MS)
+    });
+    return ticket;
+}
+
+// Usually looped on from a thread of its own, so this leaves finding flash and resetting on its
+// death to IsValid on the command threads and only reads the monitor's atomics
+std::shared_ptr<SharedSegment> BotClient::live_segment()
+{
+    pid_t pid = m_monitor.Pid(ProcessMonitor::FLASH);
+    return pid > 0 && m_monitor.Alive(ProcessMonitor::FLASH) ? m_flash.Segment(pid) : nullptr;
+}
+
+std::vector<Event> BotClient::WaitEvents(int timeout_ms, size_t max)
+{
+    // Held across the wait, a reset on another thread can't detach the segment under us
+    auto segment = live_segment();
+    if (!segment || !m_flash.Supports(CAP_EVENTS))
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(timeout_ms));
+        return { };
+    }
+
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+    EventRing &events = segment->events;
+
+    std::scoped_lock lk { m_events_mut };
+
+    // do_lib starts over with the default mask whenever it installs again
+    if (events.Mask() != m_event_mask)
+    {
+        events.SetMask(m_event_mask);
+    }
+
+    std::vector<Event> out;
+    if (events.Wait(deadline))
+    {
+        out.resize(max);
+        out.resize(events.Pop(out.data(), max));
+    }
+    return out;
+}
+
+bool BotClient::ReadGameState(MirrorFrame &out)
+{
+    auto segment = live_segment();
+    return segment && m_flash.Supports(CAP_MIRROR) && segment->mirror.Read(out);
+}
+
+BotClient::CommandStatus BotClient::poll_command(PendingCommand &command)
+{
+    if (command.status != CommandStatus::PENDING)
+    {
+        return command.status;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+
+    if (command.ring->Done(command.slot))
+    {
+        auto &slot = command.ring->At(command.slot);
+        auto *response = reinterpret_cast<const MessageHeader *>(slot.arena);
+        m_ipc_stats.Record(command.type, slot.timing, ShmRing::Now(), response->error);
+
+        auto result = read_response(response);
+        command.ring->Release(command.slot);
+
+        command.status = result.status;
+        command.value = result.value;
+    }
+    else if (now >= command.deadline || !command.ring->Ready())
+    {
+        // Nobody answers a closed ring anymore
+        command.ring->Abandon(command.slot);
+        command.status = CommandStatus::FAILED;
+        m_ipc_stats.RecordTimeout(command.type);
+    }
+    else
+    {
+        return command.status;
+    }
+
+    command.slot = -1;
+    command.expires = now + std::chrono::milliseconds(TICKET_EXPIRE_MS);
+    return command.status;
+}
+
+size_t BotClient::expire_commands()
+{
+    size_t pending = 0;
+    auto now = std::chrono::steady_clock::now();
+    for (auto it = m_commands.begin(); it != m_commands.end(); )
+    {
+        if (poll_command(*it->second) == CommandStatus::PENDING)
         {
-            fprintf(stderr, "[SendFlashCommand] Failed to get shared memory\n");
-            return;
+            pending++;
+            ++it;
         }
+        else if (now >= it->second->expires)
+        {
+            it = m_commands.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    return pending;
+}
+
+BotClient::CommandStatus BotClient::PollCommand(int ticket)
+{
+    std::scoped_lock lk { m_commands_mut };
+
+    auto it = m_commands.find(ticket);
+    if (it == m_commands.end())
+    {
+        return CommandStatus::UNKNOWN;
     }
+    return poll_command(*it->second);
+}
 
-    if (!m_shared_mem_flash || m_shared_mem_flash == (void *)-1)
+BotClient::CommandStatus BotClient::WaitCommand(int ticket, int timeout_ms)
+{
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    while (true)
     {
-        if ((m_shared_mem_flash = reinterpret_cast<Message *>(shmat(m_flash_shmid, NULL, 0))) == (void *)-1)
+        std::shared_ptr<ShmRing> ring;
+        uint32_t seen = 0;
+        auto wake_at = deadline;
+
         {
-            fprintf(stderr, "[SendFlashCommand] Failed to attach shared memory to our process\n");
-            return;
+            std::scoped_lock lk { m_commands_mut };
+
+            auto it = m_commands.find(ticket);
+            if (it == m_commands.end())
+            {
+                return CommandStatus::UNKNOWN;
+            }
+
+            // Read before polling so a completion in between isn't slept through
+            PendingCommand &command = *it->second;
+            if (command.status == CommandStatus::PENDING)
+            {
+                ring = command.ring;
+                seen = ring->Completions();
+            }
+            if (poll_command(command) != CommandStatus::PENDING)
+            {
+                return command.status;
+            }
+            wake_at = std::min(wake_at, command.deadline);
         }
+
+        if (std::chrono::steady_clock::now() >= deadline)
+        {
+            return CommandStatus::PENDING;
+        }
+
+        // Not on the slot itself, another thread may poll the ticket meanwhile and the slot
+        // go to somebody else's command. Our reference keeps the segment attached even if
+        // flash is reset and the ticket dropped in the meantime.
+        ring->WaitCompletion(seen, wake_at);
     }
+}
 
-    if (m_flash_sem < 0)
+std::vector<BotClient::CommandStatus> BotClient::WaitCommands(const std::vector<int> &tickets, int timeout_ms, bool all)
+{
+    std::vector<CommandStatus> statuses(tickets.size(), CommandStatus::UNKNOWN);
+    auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(timeout_ms);
+
+    while (true)
     {
-        if ((m_flash_sem = semget(m_flash_pid , 2, IPC_CREAT | 0600)) < 0)
+        std::shared_ptr<ShmRing> ring;
+        uint32_t seen = 0;
+        size_t finished = 0;
+        auto wake_at = deadline;
+
         {
-            m_flash_pid = -1;
-            fprintf(stderr, "[SendFlashCommand] Failed to create semaphore");
-            return;
+            std::scoped_lock lk { m_commands_mut };
+
+            for (auto &[ticket, command] : m_commands)
+            {
+                if (command->status == CommandStatus::PENDING)
+                {
+                    // Read before polling so a completion in between isn't slept through
+                    ring = command->ring;
+                    seen = ring->Completions();
+                    break;
+                }
+            }
+
+            for (size_t i = 0; i < tickets.size(); i++)
+            {
+                auto it = m_commands.find(tickets[i]);
+                statuses[i] = it == m_commands.end() ? CommandStatus::UNKNOWN : poll_command(*it->second);
+                if (statuses[i] != CommandStatus::PENDING)
+                {
+                    finished++;
+                }
+                else
+                {
+                    wake_at = std::min(wake_at, it->second->deadline);
+                }
+            }
         }
+
+        if (finished == tickets.size() || (!all && finished) || !ring ||
+                std::chrono::steady_clock::now() >= deadline)
+        {
+            return statuses;
+        }
+        ring->WaitCompletion(seen, wake_at);
+    }
+}
+
+int64_t BotClient::TakeCommandResult(int ticket)
+{
+    std::scoped_lock lk { m_commands_mut };
+
+    auto it = m_commands.find(ticket);
+    if (it == m_commands.end() || poll_command(*it->second) == CommandStatus::PENDING)
+    {
+        return 0;
+    }
+
+    int64_t value = it->second->value;
+    m_commands.erase(it);
+    return value;
+}
+
+std::vector<uintptr_t> BotClient::QueryIntRange(int32_t min, int32_t max, size_t amount)
+{
+    pid_t pid = flash_pid();
+    if (pid < 0)
+    {
+        return { };
+    }
+    std::vector<uintptr_t> result;
+    ProcUtil::QueryIntRange(pid, min, max, result, amount);
+    return result;
+}
+
+std::vector<uintptr_t> BotClient::QueryDoubleRange(double min, double max, size_t amount)
+{
+    pid_t pid = flash_pid();
+    if (pid < 0)
+    {
+        return { };
+    }
+    std::vector<uintptr_t> result;
+    ProcUtil::QueryDoubleRange(pid, min, max, result, amount);
+    return result;
+}
+
+std::vector<uintptr_t> BotClient::QueryMemoryInFlash(const uint8_t *query, const char *mask, size_t size, size_t amount, uint32_t alignment)
+{
+    if (!flash_supports(CAP_SCAN))
+    {
+        return { };
     }
 
+    if (size == 0 || sizeof(ScanMessage) + 2 * size > MAX_FRAME_SIZE)
+    {
+        return { };
+    }
+
+    Frame message(MessageType::SCAN);
+    auto *scan = message.As<ScanMessage>();
+    size_t max_results = std::min<size_t>(amount, MAX_SCAN_RESULTS);
+
+    scan->size = size;
+    scan->alignment = alignment;
+    scan->max_results = max_results;
+    message.Append(query, size);
+    message.Append(mask, size);
 
-    *m_shared_mem_flash = *message;
+    // Hits are written after the response's fixed fields, read them straight out of the segment
+    std::vector<uintptr_t> hits;
+    SendFlashCommand(message, [&] (const MessageHeader *response)
+    {
+        auto *msg = reinterpret_cast<const ScanMessage *>(response);
+        size_t found = std::min<size_t>({ msg->found, max_results, tail_size(msg) / sizeof(uintptr_t) });
+        auto *addresses = tail<const uintptr_t>(msg);
+        hits.assign(addresses, addresses + found);
+    }, SCAN_TIMEOUT_MS);
+    return hits;
+}
 
-    static timespec timeout { .tv_sec = 1, .tv_nsec = 0 };
-    sembuf sop[2] { { 0, -1, 0 }, { 1, 0, 0 } };
 
-    // Notify
-    sop[0] = { 0, -1, 0 };
-    if (semtimedop(m_flash_sem, &sop[0], 1, &timeout) == -1)
+
+std::vector<uintptr_t> BotClient::FindInstances(const std::string &class_name, size_t amount)
+{
+    if (!flash_supports(CAP_INSTANCES))
     {
-        if (errno == EAGAIN)
+        return { };
+    }
+
+    if (class_name.empty() || sizeof(InstancesMessage) + class_name.size() > MAX_FRAME_SIZE)
+    {
+        return { };
+    }
+
+    Frame message(MessageType::INSTANCES);
+    size_t max_results = std::min<size_t>(amount, MAX_INSTANCES);
+
+    message.As<InstancesMessage>()->max_results = max_results;
+    message.As<InstancesMessage>()->name_length = class_name.size();
+    message.Append(class_name);
+
+    std::vector<uintptr_t> instances;
+    SendFlashCommand(message, [&] (const MessageHeader *response)
+    {
+        auto *msg = reinterpret_cast<const InstancesMessage *>(response);
+        size_t found = std::min<size_t>({ msg->found, max_results, tail_size(msg) / sizeof(uintptr_t) });
+        auto *addresses = tail<const uintptr_t>(msg);
+        instances.assign(addresses, addresses + found);
+    }, SCAN_TIMEOUT_MS);
+    return instances;
+}
+
+std::vector<std::pair<std::string, uint64_t>> BotClient::ClassCensus()
+{
+    if (!flash_supports(CAP_CENSUS))
+    {
+        return { };
+    }
+
+    std::vector<std::pair<std::string, uint64_t>> census;
+    SendFlashCommand(Frame(MessageType::CENSUS), [&] (const MessageHeader *response)
+    {
+        auto *msg = reinterpret_cast<const CensusMessage *>(response);
+        auto *entries = tail<const CensusEntry>(msg);
+        size_t found = std::min<size_t>(msg->found, tail_size(msg) / sizeof(CensusEntry));
+
+        for (size_t i = 0; i < found; i++)
         {
-            fprintf(stderr, "[SendFlashCommand] Failed to send command to flash, timeout\n");
-            return;
+            census.emplace_back(std::string(entries[i].name, strnlen(entries[i].name, sizeof(entries[i].name))), entries[i].count);
         }
-        perror("[SendFlashCommand] semop failed");
-        return;
+    }, SCAN_TIMEOUT_MS);
+    return census;
+}
+
+int BotClient::CompilePattern(CompiledPattern &&pattern)
+{
+    if (!pattern.Valid())
+    {
+        return -1;
+    }
+
+    std::scoped_lock lk { m_scans_mut };
+    int id = m_next_pattern++;
+    m_patterns.emplace(id, std::move(pattern));
+    return id;
+}
+
+std::vector<uintptr_t> BotClient::QueryPattern(int pattern, size_t amount)
+{
+    pid_t pid = flash_pid();
+    if (pid < 0)
+    {
+        return { };
     }
 
-    // Wait
-    sop[1] = { 1, 0, 0 };
-    if (semtimedop(m_flash_sem, &sop[1], 1, &timeout) == -1)
+    // Scanned without the lock, on a copy in case the pattern is freed meanwhile
+    CompiledPattern compiled;
     {
-        if (errno == EAGAIN)
+        std::scoped_lock lk { m_scans_mut };
+        auto it = m_patterns.find(pattern);
+        if (it == m_patterns.end())
         {
-            fprintf(stderr, "[SendFlashCommand] Failed to send command to flash, timeout\n");
-            return;
+            return { };
         }
-        perror("[SendFlashCommand] semop failed");
-        return;
+        compiled = it->second;
+    }
+
+    return query_limited(pid, compiled, amount);
+}
+
+std::vector<uintptr_t> BotClient::QueryPatternIncremental(int pattern, size_t amount)
+{
+    pid_t pid = flash_pid();
+    if (pid < 0)
+    {
+        return { };
     }
 
-    if (response)
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    auto it = m_patterns.find(pattern);
+    if (it == m_patterns.end())
     {
-        memcpy(response, m_shared_mem_flash, sizeof(Message));
+        return { };
     }
+
+    auto query = m_incremental_queries.find(pattern);
+    if (query == m_incremental_queries.end() || query->second.Pid() != pid)
+    {
+        m_incremental_queries.erase(pattern);
+        query = m_incremental_queries.emplace(pattern, ProcUtil::IncrementalQuery(pid, it->second)).first;
+    }
+
+    auto &hits = query->second.Run();
+    return std::vector<uintptr_t>(hits.begin(), hits.begin() + std::min(amount, hits.size()));
+}
+
+void BotClient::FreePattern(int pattern)
+{
+    std::scoped_lock lk { m_scans_mut };
+    m_patterns.erase(pattern);
+    m_incremental_queries.erase(pattern);
+}
+
+int64_t BotClient::StreamPattern(int pattern, const ProcUtil::ResultCallback &fn)
+{
+    pid_t pid = flash_pid();
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    // fn calls back into java, which may well use the other pattern methods
+    CompiledPattern compiled;
+    {
+        std::scoped_lock lk { m_scans_mut };
+        auto it = m_patterns.find(pattern);
+        if (it == m_patterns.end())
+        {
+            return -1;
+        }
+        compiled = it->second;
+    }
+
+    return ProcUtil::StreamQuery(pid, compiled, fn);
+}
+
+std::vector<uintptr_t> BotClient::query_limited(pid_t pid, const CompiledPattern &pattern, size_t amount)
+{
+    std::vector<uintptr_t> result;
+
+    if (!amount)
+    {
+        return result;
+    }
+
+    ProcUtil::StreamQuery(pid, pattern, [&] (const uintptr_t *addresses, size_t count)
+    {
+        result.insert(result.end(), addresses, addresses + std::min(count, amount - result.size()));
+        return result.size() < amount;
+    });
+    return result;
+}
+
+int BotClient::StartQuery(int pattern, size_t amount)
+{
+    pid_t pid = flash_pid();
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    auto it = m_patterns.find(pattern);
+    if (it == m_patterns.end())
+    {
+        return -1;
+    }
+
+    int id = m_next_async_query++;
+    m_async_queries.emplace(id, std::make_unique<AsyncQuery>(pid, it->second, amount));
+    return id;
+}
+
+std::vector<uintptr_t> BotClient::PollQuery(int query)
+{
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    std::vector<uintptr_t> result;
+    auto it = m_async_queries.find(query);
+    if (it != m_async_queries.end())
+    {
+        it->second->Poll(result);
+    }
+    return result;
+}
+
+double BotClient::QueryProgress(int query)
+{
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    auto it = m_async_queries.find(query);
+    return it != m_async_queries.end() ? it->second->Progress() : -1.0;
+}
+
+bool BotClient::QueryDone(int query)
+{
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    auto it = m_async_queries.find(query);
+    return it == m_async_queries.end() || it->second->Done();
+}
+
+void BotClient::CancelQuery(int query)
+{
+    std::scoped_lock lk { m_scans_mut };
+    m_async_queries.erase(query);
+}
+
+size_t BotClient::BuildPointerIndex()
+{
+    pid_t pid = flash_pid();
+    if (pid < 0)
+    {
+        return 0;
+    }
+
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+    return m_pointer_index.Build(pid);
+}
+
+std::vector<uintptr_t> BotClient::FindReferrers(uintptr_t target)
+{
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    if (m_pointer_index.Pid() != m_flash_pid)
+    {
+        return { };
+    }
+    return m_pointer_index.Referrers(target);
+}
+
+std::vector<ProcUtil::PointerIndex::Entry> BotClient::FindReferrers(uintptr_t start, uintptr_t end)
+{
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    if (m_pointer_index.Pid() != m_flash_pid)
+    {
+        return { };
+    }
+    return m_pointer_index.Referrers(start, end);
+}
+
+int BotClient::StartScan(ScanValueType type, uint64_t value)
+{
+    pid_t pid = flash_pid();
+    if (pid < 0)
+    {
+        return -1;
+    }
+
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    int id = m_next_scan_session++;
+    auto &session = m_scan_sessions.emplace(id, ScanSession(type)).first->second;
+    session.Start(pid, value);
+    return id;
+}
+
+int64_t BotClient::RefineScan(int session, ScanPredicate predicate, uint64_t a, uint64_t b)
+{
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    auto it = m_scan_sessions.find(session);
+    if (it == m_scan_sessions.end())
+    {
+        return -1;
+    }
+    return it->second.Refine(m_flash_pid, predicate, a, b);
+}
+
+std::vector<uintptr_t> BotClient::GetScanResults(int session)
+{
+    std::scoped_lock lk { m_scans_mut };
+    drop_stale_scans();
+
+    auto it = m_scan_sessions.find(session);
+    if (it == m_scan_sessions.end())
+    {
+        return { };
+    }
+    return it->second.Addresses();
+}
+
+void BotClient::CloseScan(int session)
+{
+    std::scoped_lock lk { m_scans_mut };
+    m_scan_sessions.erase(session);
 }
 
 bool BotClient::SendNotification(uintptr_t screen_manager, const std::string &name, const std::vector<uintptr_t> &args)
 {
-    Message message;
-    message.type = MessageType::SEND_NOTIFICATION;
-    message.notify.argc = args.size();
-    std::memcpy(message.notify.argv, args.data(), sizeof(message.notify.argv));
-    std::strncpy(message.notify.name, name.c_str(), sizeof(message.notify.name));
-    SendFlashCommand(&message);
+    Frame message(MessageType::SEND_NOTIFICATION);
+    message.As<SendNotificationMessage>()->argc = args.size();
+    message.As<SendNotificationMessage>()->name_length = name.size();
+    message.Append(args.data(), args.size() * sizeof(uintptr_t));
+    message.Append(name);
+    SendFlashCommand(message);
     return true;
 }
 
-bool BotClient::RefineOre(uintptr_t refine_util, uint32_t ore, uint32_t amount)
+static Frame refine_message(uintptr_t refine_util, uint32_t ore, uint32_t amount)
+{
+    Frame message(MessageType::REFINE);
+    auto *refine = message.As<RefineMessage>();
+    refine->refine_util = refine_util;
+    refine->ore = ore;
+    refine->amount = amount;
+    return message;
+}
+
+static Frame use_item_message(const std::string &name, uint8_t type, uint8_t bar)
+{
+    std::string_view item = std::string_view(name).substr(0, UINT16_MAX);
+
+    Frame message(MessageType::USE_ITEM);
+    auto *use = message.As<UseItemMessage>();
+    use->action_type = type;
+    use->action_bar = bar;
+    use->name_length = item.size();
+    message.Append(item);
+    return message;
+}
+
+static Frame call_message(uintptr_t obj, uint32_t index, const std::vector<uintptr_t> &args)
+{
+    Frame message(MessageType::CALL);
+    auto *call = message.As<CallFunctionMessage>();
+    call->object = obj;
+    call->index = index;
+    call->argc = args.size();
+    message.Append(args.data(), args.size() * sizeof(uintptr_t));
+    return message;
+}
+
+static Frame key_message(uint32_t key)
 {
-    Message message;
-    message.type = MessageType::REFINE;
-    message.refine.refine_util = refine_util;
-    message.refine.ore = ore;
-    message.refine.amount = amount;
+    Frame message(MessageType::KEY_CLICK);
+    message.As<KeyClickMessage>()->key = key;
+    return message;
+}
+
+static Frame click_message(int32_t x, int32_t y, uint32_t button)
+{
+    Frame message(MessageType::MOUSE_CLICK);
+    auto *click = message.As<MouseClickMessage>();
+    click->x = x;
+    click->y = y;
+    click->button = button;
+    return message;
+}
 
-    SendFlashCommand(&message);
+bool BotClient::RefineOre(uintptr_t refine_util, uint32_t ore, uint32_t amount)
+{
+    SendFlashCommand(refine_message(refine_util, ore, amount));
     return true;
 }
 
 bool BotClient::UseItem(const std::string &name, uint8_t type, uint8_t bar)
 {
-    Message message;
-    message.type = MessageType::USE_ITEM;
-    message.item.action_type = type;
-    message.item.action_bar = bar;
-    std::strncpy(message.item.name, name.c_str(), sizeof(message.item.name));
-    SendFlashCommand(&message);
+    SendFlashCommand(use_item_message(name, type, bar));
     return true;
 }
 
 uintptr_t BotClient::CallMethod(uintptr_t obj, uint32_t index, const std::vector<uintptr_t> &args)
 {
-    Message message;
-    message.type = MessageType::CALL;
+    uintptr_t value = 0;
+    SendFlashCommand(call_message(obj, index, args), [&] (const MessageHeader *response)
+    {
+        value = read_response(response).value;
+    });
+    return value;
+}
 
-    message.call.object = obj;
-    message.call.index = index;
-    message.call.argc = args.size();
-    memcpy(message.call.argv, args.data(), args.size() * sizeof(uintptr_t));
+bool BotClient::ClickKey(uint32_t key)
+{
+    SendFlashCommand(key_message(key));
+    return true;
+}
 
-    Message response;
+bool BotClient::MouseClick(int32_t x, int32_t y, uint32_t button)
+{
+    SendFlashCommand(click_message(x, y, button));
+    return true;
+}
 
-    SendFlashCommand(&message, &response);
+int BotClient::RefineOreAsync(uintptr_t refine_util, uint32_t ore, uint32_t amount)
+{
+    return SendFlashCommandAsync(refine_message(refine_util, ore, amount));
+}
 
-    return response.result.value;
+int BotClient::UseItemAsync(const std::string &name, uint8_t type, uint8_t bar)
+{
+    return SendFlashCommandAsync(use_item_message(name, type, bar));
 }
 
-bool BotClient::ClickKey(uint32_t key)
+int BotClient::CallMethodAsync(uintptr_t obj, uint32_t index, const std::vector<uintptr_t> &args)
 {
-    Message message;
-    message.type = MessageType::KEY_CLICK;
-    message.key.key = key;
-    SendFlashCommand(&message);
-    return true;
+    return SendFlashCommandAsync(call_message(obj, index, args));
 }
 
-bool BotClient::MouseClick(int32_t x, int32_t y, uint32_t button)
+int BotClient::ClickKeyAsync(uint32_t key)
+{
+    return SendFlashCommandAsync(key_message(key));
+}
+
+int BotClient::MouseClickAsync(int32_t x, int32_t y, uint32_t button)
+{
+    return SendFlashCommandAsync(click_message(x, y, button));
+}
+
+int BotClient::CreateBatch()
 {
-    Message message;
-    message.type = MessageType::MOUSE_CLICK;
-    message.click.x = x;
-    message.click.y = y;
-    message.click.button = button;
-    SendFlashCommand(&message);
+    std::scoped_lock lk { m_batches_mut };
+
+    int batch = m_next_batch++;
+    m_batches[batch].reset(new CommandBatch());
+    return batch;
+}
+
+bool BotClient::add_to_batch(int batch, const Frame &message)
+{
+    std::scoped_lock lk { m_batches_mut };
+
+    auto it = m_batches.find(batch);
+    if (it == m_batches.end())
+    {
+        return false;
+    }
+
+    auto &commands = *it->second;
+    if (commands.offsets.size() >= MAX_BATCH_COMMANDS || commands.message.Size() + frame_size(message.Size()) > MAX_FRAME_SIZE)
+    {
+        return false;
+    }
+
+    commands.offsets.push_back(commands.message.Size() - sizeof(BatchMessage));
+    commands.message.Append(message.Data(), message.Size());
+    commands.message.Align();
     return true;
 }
 
-int BotClient::CheckMethodSignature(uintptr_t object, uint32_t index, bool check_name, const std::string &sig)
+bool BotClient::BatchRefineOre(int batch, uintptr_t refine_util, uint32_t ore, uint32_t amount)
+{
+    return add_to_batch(batch, refine_message(refine_util, ore, amount));
+}
+
+bool BotClient::BatchUseItem(int batch, const std::string &name, uint8_t type, uint8_t bar)
+{
+    return add_to_batch(batch, use_item_message(name, type, bar));
+}
+
+bool BotClient::BatchCallMethod(int batch, uintptr_t obj, uint32_t index, const std::vector<uintptr_t> &args)
+{
+    return add_to_batch(batch, call_message(obj, index, args));
+}
+
+bool BotClient::BatchClickKey(int batch, uint32_t key)
+{
+    return add_to_batch(batch, key_message(key));
+}
+
+bool BotClient::BatchMouseClick(int batch, int32_t x, int32_t y, uint32_t button)
+{
+    return add_to_batch(batch, click_message(x, y, button));
+}
+
+std::vector<BotClient::CommandResult> BotClient::RunBatch(int batch)
 {
-    Message message;
-    message.type = MessageType::CHECK_SIGNATURE;
-    message.sig.object = object;
-    message.sig.index = index;
-    message.sig.method_name = check_name;
+    std::unique_ptr<CommandBatch> commands;
+    {
+        std::scoped_lock lk { m_batches_mut };
+
+        auto it = m_batches.find(batch);
+        if (it == m_batches.end())
+        {
+            return { };
+        }
+        commands = std::move(it->second);
+        m_batches.erase(it);
+    }
+
+    std::vector<CommandResult> results(commands->offsets.size(), { CommandStatus::FAILED, 0 });
+    if (commands->offsets.empty() || !flash_supports(CAP_BATCH))
+    {
+        return results;
+    }
+
+    commands->message.As<BatchMessage>()->count = commands->offsets.size();
+
+    SendFlashCommand(commands->message, [&] (const MessageHeader *response)
+    {
+        auto *batch = reinterpret_cast<const BatchMessage *>(response);
+        if (batch->executed != results.size())
+        {
+            return;
+        }
 
-    strncpy(message.sig.signature, sig.c_str(), sizeof(message.sig.signature));
+        // Responses are at the same offsets as the commands they answer
+        auto *frames = tail<const uint8_t>(batch);
+        for (size_t i = 0; i < results.size(); i++)
+        {
+            results[i] = read_response(reinterpret_cast<const MessageHeader *>(frames + commands->offsets[i]));
+        }
+    }, GAME_THREAD_TIMEOUT_MS);
 
-    Message response;
-    SendFlashCommand(&message, &response);
+    return results;
+}
 
-    return response.sig.result;
+int BotClient::CheckMethodSignature(uintptr_t object, uint32_t index, bool check_name, const std::string &sig)
+{
+    Frame message(MessageType::CHECK_SIGNATURE);
+    auto *check = message.As<CheckSignatureMessage>();
+    check->object = object;
+    check->index = index;
+    check->method_name = check_name;
+    check->signature_length = sig.size();
+    message.Append(sig);
+
+    int result = -1;
+    SendFlashCommand(message, [&] (const MessageHeader *response)
+    {
+        result = reinterpret_cast<const CheckSignatureMessage *>(response)->result;
+    });
+    return result;
 }
@@ -1,10 +1,24 @@
 #ifndef BOT_CLIENT_H
 #define BOT_CLIENT_H
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <mutex>
+#include <unordered_map>
 #include "proc_util.h"
+#include "async_query.h"
+#include "flash_connection.h"
+#include "incremental_query.h"
+#include "ipc_stats.h"
+#include "pointer_index.h"
+#include "process_monitor.h"
+#include "region_table.h"
+#include "resource_sampler.h"
+#include "scan_session.h"
 
 class SockIpc;
-union Message;
+class Frame;
+struct MessageHeader;
 
 class BotClient
 {
@@ -20,7 +34,13 @@ public:
 
     void LaunchBrowser();
 
-    void SetPid(int pid) { m_browser_pid = pid; }
+    void SetPid(int pid)
+    {
+        std::scoped_lock lk { m_flash_mut };
+        m_browser_pid = pid;
+        m_browser_tree.clear();
+        m_monitor.Watch(ProcessMonitor::BROWSER, pid);
+    }
     inline int Pid() const { return m_browser_pid; }
     inline int FlashPid() const { return m_flash_pid; }
 
@@ -28,7 +48,37 @@ public:
 
     void SendBrowserCommand(const std::string &&s, int sync);
 
-    void SendFlashCommand(Message *message, Message *response = nullptr);
+    // Gets the response frame in place while the slot is still ours
+    typedef std::function<void(const MessageHeader *response)> ResponseReader;
+
+    // Safe to call from several threads, commands are queued in the ring and handled in order.
+    // Only the bytes of the frame are copied into the slot.
+    bool SendFlashCommand(const Frame &message, const ResponseReader &read = nullptr, int timeout_ms = 1000);
+
+    enum class CommandStatus
+    {
+        PENDING,
+        DONE,
+        FAILED,
+        UNKNOWN     // no such ticket, already taken or expired
+    };
+
+    struct CommandResult
+    {
+        CommandStatus status;
+        int64_t value;
+    };
+
+    // Queues a command without waiting for it, returns a ticket or -1 if too many are in flight.
+    // Tickets whose result isn't taken are forgotten a while after they finished.
+    int SendFlashCommandAsync(const Frame &message);
+    CommandStatus PollCommand(int ticket);
+    CommandStatus WaitCommand(int ticket, int timeout_ms);
+    // Waits until every ticket, or any of them if `all` is false, is no longer pending
+    std::vector<CommandStatus> WaitCommands(const std::vector<int> &tickets, int timeout_ms, bool all);
+    // Value of a finished command (CallMethod's return value, the signature check result, 0 for
+    // the rest) and forgets the ticket. Pending tickets are kept and return 0.
+    int64_t TakeCommandResult(int ticket);
 
     bool RefineOre(uintptr_t refine_util, uint32_t ore, uint32_t amount);
     bool SendNotification(uintptr_t screen_manager, const std::string &name, const std::vector<uintptr_t> &args);
@@ -38,6 +88,24 @@ public:
     bool MouseClick(int32_t x, int32_t y, uint32_t button);
     int CheckMethodSignature(uintptr_t object, uint32_t index, bool check_name, const std::string &sig);
 
+    // Same as above but only queued, return a ticket or -1
+    int RefineOreAsync(uintptr_t refine_util, uint32_t ore, uint32_t amount);
+    int UseItemAsync(const std::string &name, uint8_t type, uint8_t bar);
+    int CallMethodAsync(uintptr_t obj, uint32_t index, const std::vector<uintptr_t> &args);
+    int ClickKeyAsync(uint32_t key);
+    int MouseClickAsync(int32_t x, int32_t y, uint32_t button);
+
+    // Actions added to a batch are sent as one command and run back to back in the same frame.
+    // The Batch* methods return false if the batch doesn't exist or is full.
+    int CreateBatch();
+    bool BatchRefineOre(int batch, uintptr_t refine_util, uint32_t ore, uint32_t amount);
+    bool BatchUseItem(int batch, const std::string &name, uint8_t type, uint8_t bar);
+    bool BatchCallMethod(int batch, uintptr_t obj, uint32_t index, const std::vector<uintptr_t> &args);
+    bool BatchClickKey(int batch, uint32_t key);
+    bool BatchMouseClick(int batch, int32_t x, int32_t y, uint32_t button);
+    // Sends the batch and releases the handle, one result per action in the order they were added
+    std::vector<CommandResult> RunBatch(int batch);
+
     template <typename T>
     T Read(uintptr_t address, int *result = nullptr)
     {
@@ -67,47 +135,184 @@ public:
 
     std::vector<uintptr_t> QueryMemory(uint8_t *query, size_t size, size_t amount)
     {
-        if (m_flash_pid < 0 && !find_flash_process())
+        pid_t pid = flash_pid();
+        if (pid < 0)
         {
             return { };
         }
-        std::vector<uintptr_t> result (amount);
         std::string mask(size, 'x');
-        size_t f = ProcUtil::QueryMemory(m_flash_pid, query, mask.c_str(), &result[0], result.size());
-        result.resize(f);
-        return result;
+        return query_limited(pid, CompiledPattern(query, mask.c_str(), size), amount);
     }
 
     std::vector<uintptr_t> QueryMemory(std::vector<uint8_t> &query, size_t amount)
     {
-        if (m_flash_pid < 0 && !find_flash_process())
+        pid_t pid = flash_pid();
+        if (pid < 0)
         {
             return { };
         }
-        std::vector<uintptr_t> result(amount);
         std::string mask(query.size(), 'x');
-        size_t f = ProcUtil::QueryMemory(m_flash_pid, &query[0], mask.c_str(), &result[0], result.size());
-        result.resize(f);
-        return result;
+        return query_limited(pid, CompiledPattern(query.data(), mask.c_str(), query.size()), amount);
     }
 
+    // Every aligned value in [min, max], e.g. a coordinate known to within a unit
+    std::vector<uintptr_t> QueryIntRange(int32_t min, int32_t max, size_t amount);
+    std::vector<uintptr_t> QueryDoubleRange(double min, double max, size_t amount);
+
+    // Scans inside the flash process itself, only the hits cross the process boundary
+    std::vector<uintptr_t> QueryMemoryInFlash(const uint8_t *query, const char *mask, size_t size, size_t amount, uint32_t alignment = 1);
+
+    // Live instances of an AS3 class, found by walking the GC heap inside flash. Objects that
+    // died but weren't swept by flash's GC yet are included, the count is an upper bound.
+    std::vector<uintptr_t> FindInstances(const std::string &class_name, size_t amount);
+
+    // Live object count of every class, most common first, with the same upper bound caveat
+    std::vector<std::pair<std::string, uint64_t>> ClassCensus();
+
+    // Patterns are compiled once and referenced by handle, returns -1 if the pattern is invalid
+    int CompilePattern(CompiledPattern &&pattern);
+    std::vector<uintptr_t> QueryPattern(int pattern, size_t amount);
+    // Same but keeps every hit between calls and only re-reads pages written since the last one
+    std::vector<uintptr_t> QueryPatternIncremental(int pattern, size_t amount);
+    void FreePattern(int pattern);
+    // Every hit of a compiled pattern handed to fn in batches, fn returns false to stop.
+    // Returns the amount of hits delivered or -1 if the pattern doesn't exist.
+    int64_t StreamPattern(int pattern, const ProcUtil::ResultCallback &fn);
+
+    // Background pattern scans, StartQuery returns a handle or -1
+    int StartQuery(int pattern, size_t amount);
+    std::vector<uintptr_t> PollQuery(int query);
+    double QueryProgress(int query);
+    bool QueryDone(int query);
+    // Stops the scan if it's still running and releases the handle
+    void CancelQuery(int query);
+
+    // Reverse pointer index of the flash heap, built on demand
+    size_t BuildPointerIndex();
+    std::vector<uintptr_t> FindReferrers(uintptr_t target);
+    std::vector<ProcUtil::PointerIndex::Entry> FindReferrers(uintptr_t start, uintptr_t end);
+
+    // Recent cpu/memory/fault samples of the browser and flash, oldest first
+    inline std::vector<ResourceSampler::Sample> ProcessStats() const { return m_sampler.History(); }
+    // 0 pauses sampling
+    inline void SetStatsInterval(uint32_t interval_ms) { m_sampler.SetInterval(interval_ms); }
+
+    // Flash's rss/pss/anonymous/swap split by mapping class, oldest first
+    inline std::vector<ResourceSampler::MemorySample> MemoryHistory() const { return m_sampler.MemoryHistory(); }
+    // 0 pauses memory sampling
+    inline void SetMemoryInterval(uint32_t interval_ms) { m_sampler.SetMemoryInterval(interval_ms); }
+
+    // Protocol version and capabilities do_lib announced, 0 if not connected
+    inline uint32_t FlashProtocolVersion() const { return m_flash.Peer().version; }
+    inline uint32_t FlashCapabilities() const { return m_flash.Peer().capabilities; }
+    // Successful handshakes so far, more than one means flash was restarted or do_lib reinstalled
+    inline uint64_t FlashConnects() const { return m_flash.Connects(); }
 
+    // Blocks until do_lib pushed an event or timeout_ms passed and returns up to `max` of them.
+    // Sleeps for the timeout if flash isn't connected or can't push events, so it can be looped on.
+    // Safe next to the other calls, it only connects to a flash that IsValid already found.
+    std::vector<Event> WaitEvents(int timeout_ms, size_t max = 256);
+    // Bit (1 << EventType) for every type to receive, applied on the next WaitEvents
+    inline void SetEventMask(uint32_t mask) { m_event_mask = mask; }
+
+    // Latest tick do_lib mirrored, without a round trip to the game thread. do_lib only keeps the
+    // mirror updated while it's being read, so the first call after a pause returns false.
+    bool ReadGameState(MirrorFrame &out);
+
+    // Latency of flash commands per message type and stage, since the start or the last reset
+    inline std::vector<IpcStats::TypeStats> FlashCommandStats() const { return m_ipc_stats.Snapshot(); }
+    inline void ResetFlashCommandStats() { m_ipc_stats.Reset(); }
+
+    // How many times a maps file was parsed, the rest of the lookups hit the region table cache
+    inline uint64_t MapsReparseCount() const { return ProcUtil::RegionTable::ReparseCount(); }
+
+    // Scan sessions, returns a handle or -1 if flash isn't running
+    int StartScan(ScanValueType type, uint64_t value);
+    // Returns the number of candidates left or -1 if the session doesn't exist
+    int64_t RefineScan(int session, ScanPredicate predicate, uint64_t a, uint64_t b);
+    std::vector<uintptr_t> GetScanResults(int session);
+    void CloseScan(int session);
 
 private:
     std::unique_ptr<SockIpc> m_browser_ipc;
-    char *m_shared_mem = nullptr;
-    Message *m_shared_mem_flash = nullptr;
+
+    // Command ring shared with do_lib inside flash, connected on the first command
+    FlashConnection m_flash;
+
+    struct PendingCommand;
+    std::mutex m_commands_mut;
+    std::unordered_map<int, std::unique_ptr<PendingCommand>> m_commands;
+    int m_next_command = 1;
+
+    struct CommandBatch;
+    std::mutex m_batches_mut;
+    std::unordered_map<int, std::unique_ptr<CommandBatch>> m_batches;
+    int m_next_batch = 1;
+
+    IpcStats m_ipc_stats;
+
+    std::mutex m_events_mut;    // the event ring takes one reader at a time
+    std::atomic<uint32_t> m_event_mask { EVENT_DEFAULT_MASK };
 
     std::string m_sid;
     std::string m_url;
 
-    int m_flash_sem = -1;
-    int m_flash_shmid = -1;
+    // Held while looking for flash, restarting the browser or resetting after flash died, every
+    // command thread goes through IsValid. Recursive since IsValid ends up in LaunchBrowser
+    // and SendBrowserCommand, which are public too.
+    std::recursive_mutex m_flash_mut;
+    // Written under m_flash_mut, read without it
+    std::atomic<int> m_browser_pid { -1 }, m_flash_pid { -1 };
+
+    // Descendants of the browser as of the last flash lookup
+    std::vector<pid_t> m_browser_tree;
 
-    int m_browser_pid = -1, m_flash_pid = -1;
+    // Tells us when the browser or flash exit without checking /proc on every command
+    ProcessMonitor m_monitor;
+    ResourceSampler m_sampler { m_monitor };
 
+    // Guards the scan state below. reset() runs with m_flash_mut held and can't wait for a scan,
+    // it only bumps m_flash_generation and the state is dropped by the next call that locks this.
+    std::mutex m_scans_mut;
+    std::atomic<uint64_t> m_flash_generation { 0 };
+    uint64_t m_scans_generation = 0;
+
+    std::unordered_map<int, ScanSession> m_scan_sessions;
+    int m_next_scan_session = 1;
+
+    ProcUtil::PointerIndex m_pointer_index;
+
+    std::unordered_map<int, std::unique_ptr<AsyncQuery>> m_async_queries;
+    int m_next_async_query = 1;
+
+    std::unordered_map<int, CompiledPattern> m_patterns;
+    std::unordered_map<int, ProcUtil::IncrementalQuery> m_incremental_queries;
+    int m_next_pattern = 1;
+
+    // These three expect m_flash_mut to be held
     bool find_flash_process();
+    bool find_flash_process_slow();
     void reset();
+    // Flash's pid, looked up first if it isn't known yet, -1 if it isn't found
+    pid_t flash_pid();
+    // Expects m_scans_mut to be held, clears the scan state of a flash that was reset
+    void drop_stale_scans();
+    // Both expect m_commands_mut to be held. expire_commands also gives back the slots of the
+    // commands that finished and returns how many are still in flight.
+    CommandStatus poll_command(PendingCommand &command);
+    size_t expire_commands();
+
+    bool add_to_batch(int batch, const Frame &message);
+
+    // Segment of the flash the monitor watches, nullptr if it's gone or not found yet. Doesn't
+    // touch the state IsValid keeps, any thread can call it.
+    std::shared_ptr<SharedSegment> live_segment();
+
+    // Connects if needed, false if flash isn't reachable or its do_lib lacks any of `capabilities`
+    bool flash_supports(uint32_t capabilities);
+
+    // Up to `amount` hits, the result only grows with what is actually found
+    std::vector<uintptr_t> query_limited(pid_t pid, const CompiledPattern &pattern, size_t amount);
 };
 
 
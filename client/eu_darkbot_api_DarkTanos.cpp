@@ -2,6 +2,7 @@
 #include "eu_darkbot_api_DarkTanos.h"
 #include <unistd.h>
 #include <cstring>
+#include <memory>
 
 #include "bot_client.h"
 #include "utils.h"
@@ -308,3 +309,578 @@ JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_checkMethodSignature
     return result;
 }
 
+// Values are raw bits, use Double.doubleToRawLongBits for double sessions
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_startScan
+  (JNIEnv *, jobject, jint jtype, jlong jvalue)
+{
+    if (jtype < 0 || jtype > static_cast<jint>(ScanValueType::DOUBLE))
+    {
+        return -1;
+    }
+    return client.StartScan(static_cast<ScanValueType>(jtype), jvalue);
+}
+
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_refineScan
+  (JNIEnv *, jobject, jint jsession, jint jpredicate, jlong ja, jlong jb)
+{
+    if (jpredicate < 0 || jpredicate >= static_cast<jint>(ScanPredicate::NONE))
+    {
+        return -1;
+    }
+    return client.RefineScan(jsession, static_cast<ScanPredicate>(jpredicate), ja, jb);
+}
+
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getScanResults
+  (JNIEnv *env, jobject, jint jsession)
+{
+    auto out = client.GetScanResults(jsession);
+    jlongArray addresses = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(addresses, (jsize)0, (jsize)out.size(), reinterpret_cast<jlong*>(out.data()));
+    return addresses;
+}
+
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_closeScan
+  (JNIEnv *, jobject, jint jsession)
+{
+    client.CloseScan(jsession);
+}
+
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_compilePattern__Ljava_lang_String_2
+  (JNIEnv *env, jobject, jstring jpattern)
+{
+    const char *pattern_cstr = env->GetStringUTFChars(jpattern, NULL);
+
+    int result = client.CompilePattern(CompiledPattern(pattern_cstr));
+
+    env->ReleaseStringUTFChars(jpattern, pattern_cstr);
+
+    return result;
+}
+
+// mask[i] == '?' is a wildcard, anything else has to match
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_compilePattern___3BLjava_lang_String_2
+  (JNIEnv *env, jobject, jbyteArray jbytes, jstring jmask)
+{
+    size_t size = env->GetArrayLength(jbytes);
+
+    std::vector<uint8_t> bytes(size);
+    env->GetByteArrayRegion(jbytes, 0, size, reinterpret_cast<jbyte*>(bytes.data()));
+
+    const char *mask_cstr = env->GetStringUTFChars(jmask, NULL);
+    std::string mask = mask_cstr;
+    env->ReleaseStringUTFChars(jmask, mask_cstr);
+
+    if (mask.size() != size)
+    {
+        return -1;
+    }
+
+    return client.CompilePattern(CompiledPattern(bytes.data(), mask.c_str(), size));
+}
+
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryPattern
+  (JNIEnv *env, jobject, jint jpattern, jint jamount)
+{
+    auto out = client.QueryPattern(jpattern, static_cast<uint32_t>(jamount));
+    jlongArray addresses = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(addresses, (jsize)0, (jsize)out.size(), reinterpret_cast<jlong*>(out.data()));
+    return addresses;
+}
+
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryPatternIncremental
+  (JNIEnv *env, jobject, jint jpattern, jint jamount)
+{
+    auto out = client.QueryPatternIncremental(jpattern, static_cast<uint32_t>(jamount));
+    jlongArray addresses = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(addresses, (jsize)0, (jsize)out.size(), reinterpret_cast<jlong*>(out.data()));
+    return addresses;
+}
+
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_freePattern
+  (JNIEnv *, jobject, jint jpattern)
+{
+    client.FreePattern(jpattern);
+}
+
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_buildPointerIndex
+  (JNIEnv *, jobject)
+{
+    return client.BuildPointerIndex();
+}
+
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_findReferrers
+  (JNIEnv *env, jobject, jlong jtarget)
+{
+    auto out = client.FindReferrers(jtarget);
+    jlongArray addresses = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(addresses, (jsize)0, (jsize)out.size(), reinterpret_cast<jlong*>(out.data()));
+    return addresses;
+}
+
+// Returns { target0, source0, target1, source1, ... } for targets in [start, end)
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_findReferrersInRange
+  (JNIEnv *env, jobject, jlong jstart, jlong jend)
+{
+    auto out = client.FindReferrers(jstart, jend);
+    static_assert(sizeof(out[0]) == 2 * sizeof(jlong), "Entry must be two longs");
+    jlongArray pairs = env->NewLongArray(out.size() * 2);
+    env->SetLongArrayRegion(pairs, (jsize)0, (jsize)out.size() * 2, reinterpret_cast<jlong*>(out.data()));
+    return pairs;
+}
+
+// Runs a compiled pattern on a native thread, amount = 0 means no limit
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_startQuery
+  (JNIEnv *, jobject, jint jpattern, jint jamount)
+{
+    return client.StartQuery(jpattern, jamount > 0 ? jamount : 0);
+}
+
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_pollQuery
+  (JNIEnv *env, jobject, jint jquery)
+{
+    auto out = client.PollQuery(jquery);
+    jlongArray addresses = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(addresses, (jsize)0, (jsize)out.size(), reinterpret_cast<jlong*>(out.data()));
+    return addresses;
+}
+
+JNIEXPORT jdouble JNICALL Java_eu_darkbot_api_DarkTanos_getQueryProgress
+  (JNIEnv *, jobject, jint jquery)
+{
+    return client.QueryProgress(jquery);
+}
+
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_isQueryDone
+  (JNIEnv *, jobject, jint jquery)
+{
+    return client.QueryDone(jquery);
+}
+
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_cancelQuery
+  (JNIEnv *, jobject, jint jquery)
+{
+    client.CancelQuery(jquery);
+}
+
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryBytesInFlash
+  (JNIEnv *env, jobject, jbyteArray jbytes, jstring jmask, jint jamount)
+{
+    size_t size = env->GetArrayLength(jbytes);
+
+    std::vector<uint8_t> bytes(size);
+    env->GetByteArrayRegion(jbytes, 0, size, reinterpret_cast<jbyte*>(bytes.data()));
+
+    const char *mask_cstr = env->GetStringUTFChars(jmask, NULL);
+    std::string mask = mask_cstr;
+    env->ReleaseStringUTFChars(jmask, mask_cstr);
+
+    std::vector<uintptr_t> out;
+    if (mask.size() == size)
+    {
+        out = client.QueryMemoryInFlash(bytes.data(), mask.c_str(), size, static_cast<uint32_t>(jamount));
+    }
+
+    jlongArray addresses = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(addresses, (jsize)0, (jsize)out.size(), reinterpret_cast<jlong*>(out.data()));
+    return addresses;
+}
+
+// Objects that died but weren't swept by flash's GC yet can still be listed
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_findInstances
+  (JNIEnv *env, jobject, jstring jclass_name, jint jamount)
+{
+    const char *class_name = env->GetStringUTFChars(jclass_name, NULL);
+    auto out = client.FindInstances(class_name, static_cast<uint32_t>(jamount));
+    env->ReleaseStringUTFChars(jclass_name, class_name);
+
+    jlongArray addresses = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(addresses, (jsize)0, (jsize)out.size(), reinterpret_cast<jlong*>(out.data()));
+    return addresses;
+}
+
+// Entries are "<class name>\t<live objects>", which may count objects not swept yet
+JNIEXPORT jobjectArray JNICALL Java_eu_darkbot_api_DarkTanos_getClassCensus
+  (JNIEnv *env, jobject)
+{
+    auto census = client.ClassCensus();
+
+    jobjectArray entries = env->NewObjectArray(census.size(), env->FindClass("java/lang/String"), NULL);
+    for (size_t i = 0; i < census.size(); i++)
+    {
+        std::string entry = census[i].first + "\t" + std::to_string(census[i].second);
+        jstring jentry = env->NewStringUTF(entry.c_str());
+        env->SetObjectArrayElement(entries, i, jentry);
+        env->DeleteLocalRef(jentry);
+    }
+    return entries;
+}
+
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryIntRange
+  (JNIEnv *env, jobject, jint jmin, jint jmax, jint jamount)
+{
+    auto out = client.QueryIntRange(jmin, jmax, static_cast<uint32_t>(jamount));
+    jlongArray addresses = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(addresses, (jsize)0, (jsize)out.size(), reinterpret_cast<jlong*>(out.data()));
+    return addresses;
+}
+
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryDoubleRange
+  (JNIEnv *env, jobject, jdouble jmin, jdouble jmax, jint jamount)
+{
+    auto out = client.QueryDoubleRange(jmin, jmax, static_cast<uint32_t>(jamount));
+    jlongArray addresses = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(addresses, (jsize)0, (jsize)out.size(), reinterpret_cast<jlong*>(out.data()));
+    return addresses;
+}
+
+// The callback is any object with a `boolean onResults(long[] addresses)` method,
+// returning false or throwing stops the scan
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_streamPattern
+  (JNIEnv *env, jobject, jint jpattern, jobject jcallback)
+{
+    jclass callback_class = env->GetObjectClass(jcallback);
+    jmethodID on_results = env->GetMethodID(callback_class, "onResults", "([J)Z");
+    env->DeleteLocalRef(callback_class);
+
+    if (!on_results)
+    {
+        return -1;
+    }
+
+    return client.StreamPattern(jpattern, [&] (const uintptr_t *results, size_t count)
+    {
+        jlongArray addresses = env->NewLongArray(count);
+        env->SetLongArrayRegion(addresses, (jsize)0, (jsize)count, reinterpret_cast<const jlong*>(results));
+
+        bool more = env->CallBooleanMethod(jcallback, on_results, addresses);
+        env->DeleteLocalRef(addresses);
+
+        return more && !env->ExceptionCheck();
+    });
+}
+
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_getMapsReparseCount
+  (JNIEnv *, jobject)
+{
+    return client.MapsReparseCount();
+}
+
+// 9 longs per sample, oldest first: timestamp ms, process (0 browser, 1 flash), pid,
+// cpu ms, rss kB, minor faults, major faults, voluntary and involuntary context switches
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getProcessStats
+  (JNIEnv *env, jobject)
+{
+    auto history = client.ProcessStats();
+
+    std::vector<jlong> out;
+    out.reserve(history.size() * 9);
+    for (auto &sample : history)
+    {
+        out.insert(out.end(), {
+            sample.timestamp_ms, sample.slot, sample.pid,
+            (jlong)sample.stats.cpu_ms, (jlong)sample.stats.rss,
+            (jlong)sample.stats.minflt, (jlong)sample.stats.majflt,
+            (jlong)sample.stats.voluntary_ctxt, (jlong)sample.stats.nonvoluntary_ctxt
+        });
+    }
+
+    jlongArray stats = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(stats, (jsize)0, (jsize)out.size(), out.data());
+    return stats;
+}
+
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_setStatsInterval
+  (JNIEnv *, jobject, jint jinterval)
+{
+    client.SetStatsInterval(jinterval > 0 ? jinterval : 0);
+}
+
+// 27 longs per sample, oldest first: timestamp ms, pid, 1 if the classes were re-read for this
+// sample (0 if only the total is new), then rss, pss, anonymous and swap in kB for the total
+// followed by flash code, jit, heap, files and other mappings
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getMemoryBreakdown
+  (JNIEnv *env, jobject)
+{
+    auto history = client.MemoryHistory();
+
+    std::vector<jlong> out;
+    out.reserve(history.size() * (3 + 4 * (1 + ProcUtil::MAPPING_CLASS_COUNT)));
+
+    auto add_usage = [&out] (const ProcUtil::MemoryUsage &usage)
+    {
+        out.insert(out.end(), { (jlong)usage.rss, (jlong)usage.pss, (jlong)usage.anonymous, (jlong)usage.swap });
+    };
+
+    for (auto &sample : history)
+    {
+        out.insert(out.end(), { sample.timestamp_ms, sample.pid, sample.detailed });
+        add_usage(sample.memory.total);
+        for (auto &usage : sample.memory.classes)
+        {
+            add_usage(usage);
+        }
+    }
+
+    jlongArray breakdown = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(breakdown, (jsize)0, (jsize)out.size(), out.data());
+    return breakdown;
+}
+
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_setMemoryInterval
+  (JNIEnv *, jobject, jint jinterval)
+{
+    client.SetMemoryInterval(jinterval > 0 ? jinterval : 0);
+}
+
+// The *Async variants queue the action and return a ticket (-1 if flash isn't reachable or too
+// many commands are in flight). Ticket status: 0 pending, 1 done, 2 failed, 3 unknown/expired.
+
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_useItemAsync
+  (JNIEnv *env, jobject, jlong conn_manager, jstring jname, jint jdunno, jlongArray jargs)
+{
+    const char *name = env->GetStringUTFChars(jname, NULL);
+    int ticket = client.UseItemAsync(name, 1, 0);
+    env->ReleaseStringUTFChars(jname, name);
+    return ticket;
+}
+
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_refineAsync
+  (JNIEnv *, jobject, jlong joreutils, jint jore, jint jamount)
+{
+    return client.RefineOreAsync(joreutils, jore, jamount);
+}
+
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_keyClickAsync
+  (JNIEnv *, jobject, jint c)
+{
+    return client.ClickKeyAsync(c);
+}
+
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_mouseClickAsync
+  (JNIEnv *, jobject, jint x, jint y)
+{
+    return client.MouseClickAsync(x, y, 1);
+}
+
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_callMethodAsync
+  (JNIEnv *env, jobject, jlong jthis, jint jindex, jlongArray jargs)
+{
+    std::vector<uintptr_t> args(env->GetArrayLength(jargs));
+
+    env->GetLongArrayRegion(jargs, 0, args.size(), reinterpret_cast<jlong *>(args.data()));
+    return client.CallMethodAsync(jthis, jindex, args);
+}
+
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_pollCommand
+  (JNIEnv *, jobject, jint jticket)
+{
+    return static_cast<jint>(client.PollCommand(jticket));
+}
+
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_waitCommand
+  (JNIEnv *, jobject, jint jticket, jint jtimeout)
+{
+    return static_cast<jint>(client.WaitCommand(jticket, jtimeout > 0 ? jtimeout : 0));
+}
+
+// Waits until all tickets (or any, if jall is false) finished, returns the status of each
+JNIEXPORT jintArray JNICALL Java_eu_darkbot_api_DarkTanos_awaitCommands
+  (JNIEnv *env, jobject, jintArray jtickets, jint jtimeout, jboolean jall)
+{
+    std::vector<jint> tickets(env->GetArrayLength(jtickets));
+    env->GetIntArrayRegion(jtickets, 0, tickets.size(), tickets.data());
+
+    auto statuses = client.WaitCommands(std::vector<int>(tickets.begin(), tickets.end()), jtimeout > 0 ? jtimeout : 0, jall);
+
+    std::vector<jint> out;
+    for (auto status : statuses)
+    {
+        out.push_back(static_cast<jint>(status));
+    }
+
+    jintArray result = env->NewIntArray(out.size());
+    env->SetIntArrayRegion(result, (jsize)0, (jsize)out.size(), out.data());
+    return result;
+}
+
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_takeCommandResult
+  (JNIEnv *, jobject, jint jticket)
+{
+    return client.TakeCommandResult(jticket);
+}
+
+// Actions added to a batch are sent together by runBatch and run in the same frame
+
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_createBatch
+  (JNIEnv *, jobject)
+{
+    return client.CreateBatch();
+}
+
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchUseItem
+  (JNIEnv *env, jobject, jint jbatch, jstring jname)
+{
+    const char *name = env->GetStringUTFChars(jname, NULL);
+    bool ok = client.BatchUseItem(jbatch, name, 1, 0);
+    env->ReleaseStringUTFChars(jname, name);
+    return ok;
+}
+
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchRefine
+  (JNIEnv *, jobject, jint jbatch, jlong joreutils, jint jore, jint jamount)
+{
+    return client.BatchRefineOre(jbatch, joreutils, jore, jamount);
+}
+
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchKeyClick
+  (JNIEnv *, jobject, jint jbatch, jint c)
+{
+    return client.BatchClickKey(jbatch, c);
+}
+
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchMouseClick
+  (JNIEnv *, jobject, jint jbatch, jint x, jint y)
+{
+    return client.BatchMouseClick(jbatch, x, y, 1);
+}
+
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchCallMethod
+  (JNIEnv *env, jobject, jint jbatch, jlong jthis, jint jindex, jlongArray jargs)
+{
+    std::vector<uintptr_t> args(env->GetArrayLength(jargs));
+
+    env->GetLongArrayRegion(jargs, 0, args.size(), reinterpret_cast<jlong *>(args.data()));
+    return client.BatchCallMethod(jbatch, jthis, jindex, args);
+}
+
+// 2 longs per action in the order they were added: status (1 done, 2 failed) and the value
+// (callMethod's return value, 0 for the rest)
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_runBatch
+  (JNIEnv *env, jobject, jint jbatch)
+{
+    std::vector<jlong> out;
+    for (auto &result : client.RunBatch(jbatch))
+    {
+        out.insert(out.end(), { static_cast<jlong>(result.status), result.value });
+    }
+
+    jlongArray results = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(results, (jsize)0, (jsize)out.size(), out.data());
+    return results;
+}
+
+// Protocol version and capability bits do_lib announced (0 if not connected) and how many
+// times a connection was made
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getFlashConnection
+  (JNIEnv *env, jobject)
+{
+    jlong info[] = {
+        (jlong)client.FlashProtocolVersion(),
+        (jlong)client.FlashCapabilities(),
+        (jlong)client.FlashConnects()
+    };
+
+    jlongArray result = env->NewLongArray(3);
+    env->SetLongArrayRegion(result, (jsize)0, (jsize)3, info);
+    return result;
+}
+
+// Events pushed by do_lib, 4 longs each: type, id, CLOCK_MONOTONIC ns, value.
+// Empty once the timeout passed without any.
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_waitEvents
+  (JNIEnv *env, jobject, jint jtimeout)
+{
+    auto events = client.WaitEvents(jtimeout > 0 ? jtimeout : 0);
+
+    std::vector<jlong> out;
+    out.reserve(events.size() * 4);
+    for (auto &event : events)
+    {
+        out.insert(out.end(), { (jlong)event.type, (jlong)event.id, (jlong)event.time_ns, (jlong)event.value });
+    }
+
+    jlongArray result = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(result, (jsize)0, (jsize)out.size(), out.data());
+    return result;
+}
+
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_setEventMask
+  (JNIEnv *, jobject, jint jmask)
+{
+    client.SetEventMask(jmask);
+}
+
+// [tick, time_ns, player id, player x, player y, player object, ship count] then
+// [id, visible, x, y, object] per ship, coordinates as raw double bits. Empty without a recent tick.
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getGameState
+  (JNIEnv *env, jobject)
+{
+    // Too big for the stack of a JNI call, one per calling thread
+    thread_local std::unique_ptr<MirrorFrame> frame = std::make_unique<MirrorFrame>();
+
+    if (!client.ReadGameState(*frame))
+    {
+        return env->NewLongArray(0);
+    }
+
+    auto bits = [](double d)
+    {
+        jlong l;
+        std::memcpy(&l, &d, sizeof(l));
+        return l;
+    };
+
+    std::vector<jlong> out;
+    out.reserve(7 + frame->ship_count * 5);
+    out.insert(out.end(), { (jlong)frame->tick, (jlong)frame->time_ns, (jlong)frame->player_id,
+            bits(frame->player_x), bits(frame->player_y), (jlong)frame->player_object, (jlong)frame->ship_count });
+
+    for (uint32_t i = 0; i < frame->ship_count; i++)
+    {
+        auto &ship = frame->ships[i];
+        out.insert(out.end(), { (jlong)ship.id, (jlong)ship.visible, bits(ship.x), bits(ship.y), (jlong)ship.object });
+    }
+
+    jlongArray result = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(result, (jsize)0, (jsize)out.size(), out.data());
+    return result;
+}
+
+// 44 longs per message type that was sent: type, answered, failed, timed out, then for each stage
+// (queued, scheduled, run, reply, total) count, min, p50, p90, p99, p99.9, max and sum in ns
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getIpcStats
+  (JNIEnv *env, jobject)
+{
+    auto types = client.FlashCommandStats();
+
+    std::vector<jlong> out;
+    for (size_t type = 0; type < types.size(); type++)
+    {
+        auto &stats = types[type];
+        if (!stats.answered && !stats.timeouts)
+        {
+            continue;
+        }
+
+        out.insert(out.end(), { (jlong)type, (jlong)stats.answered, (jlong)stats.failed, (jlong)stats.timeouts });
+        for (auto &stage : stats.stages)
+        {
+            out.insert(out.end(), {
+                (jlong)stage.count, (jlong)stage.min,
+                (jlong)stage.Percentile(0.5), (jlong)stage.Percentile(0.9),
+                (jlong)stage.Percentile(0.99), (jlong)stage.Percentile(0.999),
+                (jlong)stage.max, (jlong)stage.sum
+            });
+        }
+    }
+
+    jlongArray result = env->NewLongArray(out.size());
+    env->SetLongArrayRegion(result, (jsize)0, (jsize)out.size(), out.data());
+    return result;
+}
+
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_resetIpcStats
+  (JNIEnv *, jobject)
+{
+    client.ResetFlashCommandStats();
+}
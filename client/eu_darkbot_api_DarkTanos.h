@@ -319,6 +319,406 @@ JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_callMethod
 JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_checkMethodSignature
   (JNIEnv *, jobject, jlong, jint, jboolean, jstring);
 
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    startScan
+ * Signature: (IJ)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_startScan
+  (JNIEnv *, jobject, jint, jlong);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    refineScan
+ * Signature: (IIJJ)J
+ */
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_refineScan
+  (JNIEnv *, jobject, jint, jint, jlong, jlong);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    getScanResults
+ * Signature: (I)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getScanResults
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    closeScan
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_closeScan
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    compilePattern
+ * Signature: (Ljava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_compilePattern__Ljava_lang_String_2
+  (JNIEnv *, jobject, jstring);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    compilePattern
+ * Signature: ([BLjava/lang/String;)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_compilePattern___3BLjava_lang_String_2
+  (JNIEnv *, jobject, jbyteArray, jstring);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    queryPattern
+ * Signature: (II)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryPattern
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    queryPatternIncremental
+ * Signature: (II)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryPatternIncremental
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    freePattern
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_freePattern
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    buildPointerIndex
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_buildPointerIndex
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    findReferrers
+ * Signature: (J)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_findReferrers
+  (JNIEnv *, jobject, jlong);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    findReferrersInRange
+ * Signature: (JJ)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_findReferrersInRange
+  (JNIEnv *, jobject, jlong, jlong);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    startQuery
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_startQuery
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    pollQuery
+ * Signature: (I)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_pollQuery
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    getQueryProgress
+ * Signature: (I)D
+ */
+JNIEXPORT jdouble JNICALL Java_eu_darkbot_api_DarkTanos_getQueryProgress
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    isQueryDone
+ * Signature: (I)Z
+ */
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_isQueryDone
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    cancelQuery
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_cancelQuery
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    queryBytesInFlash
+ * Signature: ([BLjava/lang/String;I)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryBytesInFlash
+  (JNIEnv *, jobject, jbyteArray, jstring, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    findInstances
+ * Signature: (Ljava/lang/String;I)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_findInstances
+  (JNIEnv *, jobject, jstring, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    getClassCensus
+ * Signature: ()[Ljava/lang/String;
+ */
+JNIEXPORT jobjectArray JNICALL Java_eu_darkbot_api_DarkTanos_getClassCensus
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    queryIntRange
+ * Signature: (III)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryIntRange
+  (JNIEnv *, jobject, jint, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    queryDoubleRange
+ * Signature: (DDI)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_queryDoubleRange
+  (JNIEnv *, jobject, jdouble, jdouble, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    streamPattern
+ * Signature: (ILjava/lang/Object;)J
+ */
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_streamPattern
+  (JNIEnv *, jobject, jint, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    getMapsReparseCount
+ * Signature: ()J
+ */
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_getMapsReparseCount
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    getProcessStats
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getProcessStats
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    setStatsInterval
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_setStatsInterval
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    getMemoryBreakdown
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getMemoryBreakdown
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    setMemoryInterval
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_setMemoryInterval
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    useItemAsync
+ * Signature: (JLjava/lang/String;I[J)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_useItemAsync
+  (JNIEnv *, jobject, jlong, jstring, jint, jlongArray);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    refineAsync
+ * Signature: (JII)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_refineAsync
+  (JNIEnv *, jobject, jlong, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    keyClickAsync
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_keyClickAsync
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    mouseClickAsync
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_mouseClickAsync
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    callMethodAsync
+ * Signature: (JI[J)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_callMethodAsync
+  (JNIEnv *, jobject, jlong, jint, jlongArray);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    pollCommand
+ * Signature: (I)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_pollCommand
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    waitCommand
+ * Signature: (II)I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_waitCommand
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    awaitCommands
+ * Signature: ([IIZ)[I
+ */
+JNIEXPORT jintArray JNICALL Java_eu_darkbot_api_DarkTanos_awaitCommands
+  (JNIEnv *, jobject, jintArray, jint, jboolean);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    takeCommandResult
+ * Signature: (I)J
+ */
+JNIEXPORT jlong JNICALL Java_eu_darkbot_api_DarkTanos_takeCommandResult
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    createBatch
+ * Signature: ()I
+ */
+JNIEXPORT jint JNICALL Java_eu_darkbot_api_DarkTanos_createBatch
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    batchUseItem
+ * Signature: (ILjava/lang/String;)Z
+ */
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchUseItem
+  (JNIEnv *, jobject, jint, jstring);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    batchRefine
+ * Signature: (IJII)Z
+ */
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchRefine
+  (JNIEnv *, jobject, jint, jlong, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    batchKeyClick
+ * Signature: (II)Z
+ */
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchKeyClick
+  (JNIEnv *, jobject, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    batchMouseClick
+ * Signature: (III)Z
+ */
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchMouseClick
+  (JNIEnv *, jobject, jint, jint, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    batchCallMethod
+ * Signature: (IJI[J)Z
+ */
+JNIEXPORT jboolean JNICALL Java_eu_darkbot_api_DarkTanos_batchCallMethod
+  (JNIEnv *, jobject, jint, jlong, jint, jlongArray);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    runBatch
+ * Signature: (I)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_runBatch
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    getFlashConnection
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getFlashConnection
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    waitEvents
+ * Signature: (I)[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_waitEvents
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    setEventMask
+ * Signature: (I)V
+ */
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_setEventMask
+  (JNIEnv *, jobject, jint);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    getGameState
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getGameState
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    getIpcStats
+ * Signature: ()[J
+ */
+JNIEXPORT jlongArray JNICALL Java_eu_darkbot_api_DarkTanos_getIpcStats
+  (JNIEnv *, jobject);
+
+/*
+ * Class:     eu_darkbot_api_DarkTanos
+ * Method:    resetIpcStats
+ * Signature: ()V
+ */
+JNIEXPORT void JNICALL Java_eu_darkbot_api_DarkTanos_resetIpcStats
+  (JNIEnv *, jobject);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,109 @@
+#include "flash_connection.h"
+
+#include <cstdio>
+
+#include <sys/ipc.h>
+#include <sys/shm.h>
+
+FlashConnection::~FlashConnection()
+{
+    Disconnect();
+}
+
+FlashConnection::Connection::~Connection()
+{
+    shmdt(segment);
+}
+
+void FlashConnection::Disconnect()
+{
+    std::scoped_lock lk { m_mut };
+
+    // Detached by whoever holds the last reference
+    std::atomic_store(&m_connection, std::shared_ptr<Connection>());
+    m_refused_pid = -1;
+}
+
+bool FlashConnection::check(const ShmRing::Handshake &peer) const
+{
+    if (peer.version != m_expected.version)
+    {
+        fprintf(stderr, "[FlashConnection] Protocol version %u, expected %u\n", peer.version, m_expected.version);
+        return false;
+    }
+
+    if (peer.message_types != m_expected.message_types)
+    {
+        fprintf(stderr, "[FlashConnection] %u message types, expected %u\n", peer.message_types, m_expected.message_types);
+        return false;
+    }
+
+    for (uint32_t i = 0; i < m_expected.message_types && i < SHM_MAX_MESSAGE_TYPES; i++)
+    {
+        if (peer.message_sizes[i] != m_expected.message_sizes[i])
+        {
+            fprintf(stderr, "[FlashConnection] Message type %u is %u bytes, expected %u\n",
+                    i, peer.message_sizes[i], m_expected.message_sizes[i]);
+            return false;
+        }
+    }
+    return true;
+}
+
+std::shared_ptr<FlashConnection::Connection> FlashConnection::connect(pid_t pid)
+{
+    std::scoped_lock lk { m_mut };
+
+    if (auto connection = std::atomic_load(&m_connection))
+    {
+        if (connection->segment->ring.Ready())
+        {
+            return connection;
+        }
+
+        // Detached once the threads still waiting on it noticed
+        fprintf(stderr, "[FlashConnection] do_lib closed the ring, connecting again\n");
+        std::atomic_store(&m_connection, std::shared_ptr<Connection>());
+    }
+    if (pid <= 0 || pid == m_refused_pid)
+    {
+        return nullptr;
+    }
+
+    // do_lib creates the segment, if it isn't there flash isn't ready yet
+    int shmid = shmget(pid, sizeof(SharedSegment), 0);
+    if (shmid < 0)
+    {
+        fprintf(stderr, "[FlashConnection] Failed to get shared memory\n");
+        return nullptr;
+    }
+
+    void *shared = shmat(shmid, NULL, 0);
+    if (shared == (void *)-1)
+    {
+        fprintf(stderr, "[FlashConnection] Failed to attach shared memory to our process\n");
+        return nullptr;
+    }
+
+    auto *segment = reinterpret_cast<SharedSegment *>(shared);
+    ShmRing *ring = &segment->ring;
+    if (!ring->Ready())
+    {
+        fprintf(stderr, "[FlashConnection] Command ring isn't initialized yet\n");
+        shmdt(shared);
+        return nullptr;
+    }
+
+    if (!check(ring->Peer()))
+    {
+        fprintf(stderr, "[FlashConnection] do_lib in %d doesn't match this client, not sending it anything\n", pid);
+        m_refused_pid = pid;
+        shmdt(shared);
+        return nullptr;
+    }
+
+    auto connection = std::make_shared<Connection>(segment, ring->Peer());
+    m_connects++;
+    std::atomic_store(&m_connection, connection);
+    return connection;
+}
@@ -0,0 +1,87 @@
+#ifndef FLASH_CONNECTION_H
+#define FLASH_CONNECTION_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+
+#include <sys/types.h>
+
+#include "protocol.h"
+
+// Attachment to the shared segment of the do_lib instance inside flash. The segment is attached
+// and the handshake checked once, after that Get() is a single atomic load. Callers keep the
+// returned pointer for as long as they touch the segment, it's only detached once the last of
+// them let go, so Disconnect can't unmap it under a thread sleeping on the ring. The connection
+// is dropped when the owner saw flash die, or here when do_lib closed the ring to uninstall,
+// it creates a new segment if it installs again inside the same flash.
+class FlashConnection
+{
+public:
+    // server_pid and capabilities of `expected` are not compared
+    FlashConnection(const ShmRing::Handshake &expected) : m_expected(expected) { }
+    ~FlashConnection();
+
+    FlashConnection(const FlashConnection &) = delete;
+    FlashConnection &operator=(const FlashConnection &) = delete;
+
+    // The connected ring, connecting to `pid` first if needed. nullptr if do_lib isn't ready yet
+    // or speaks a different protocol, a pid that failed the handshake isn't tried again.
+    inline std::shared_ptr<ShmRing> Get(pid_t pid)
+    {
+        auto segment = Segment(pid);
+        return segment ? std::shared_ptr<ShmRing>(segment, &segment->ring) : nullptr;
+    }
+
+    inline std::shared_ptr<SharedSegment> Segment(pid_t pid)
+    {
+        auto connection = std::atomic_load(&m_connection);
+        if (!connection || !connection->segment->ring.Ready())
+        {
+            connection = connect(pid);
+        }
+        return connection ? std::shared_ptr<SharedSegment>(connection, connection->segment) : nullptr;
+    }
+
+    void Disconnect();
+
+    inline bool Connected() const { return std::atomic_load(&m_connection) != nullptr; }
+
+    // What do_lib published, all zero while not connected
+    inline ShmRing::Handshake Peer() const
+    {
+        auto connection = std::atomic_load(&m_connection);
+        return connection ? connection->peer : ShmRing::Handshake { };
+    }
+
+    inline bool Supports(uint32_t capabilities) const
+    {
+        auto connection = std::atomic_load(&m_connection);
+        return connection && (connection->peer.capabilities & capabilities) == capabilities;
+    }
+
+    inline uint64_t Connects() const { return m_connects; }
+
+private:
+    struct Connection
+    {
+        Connection(SharedSegment *segment, const ShmRing::Handshake &peer) : segment(segment), peer(peer) { }
+        ~Connection();
+
+        SharedSegment *segment;
+        ShmRing::Handshake peer;
+    };
+
+    std::shared_ptr<Connection> connect(pid_t pid);
+    bool check(const ShmRing::Handshake &peer) const;
+
+    const ShmRing::Handshake m_expected;
+
+    std::mutex m_mut;
+    std::shared_ptr<Connection> m_connection;   // only through std::atomic_load / atomic_store
+    pid_t m_refused_pid = -1;
+    std::atomic<uint64_t> m_connects { 0 };
+};
+
+#endif /* FLASH_CONNECTION_H */
@@ -0,0 +1,254 @@
+#include "incremental_query.h"
+
+#include <algorithm>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "proc_util.h"
+
+#define PM_SOFT_DIRTY   (1ULL << 55)
+
+// Once more than 1/N of the pages are dirty a full scan starts over with clean bits
+#define DIRTY_FULL_SCAN_DIVISOR 2
+
+static std::mutex generations_mut;
+static std::unordered_map<pid_t, uint64_t> generations;
+static uint64_t last_generation = 0;
+
+static uint64_t current_generation(pid_t pid)
+{
+    std::scoped_lock lk { generations_mut };
+    auto it = generations.find(pid);
+    return it != generations.end() ? it->second : 0;
+}
+
+// Kernels built without CONFIG_MEM_SOFT_DIRTY never report the bit, which would make every
+// page look clean forever. A page we just wrote in a fresh mapping always reads as dirty otherwise.
+static bool soft_dirty_supported()
+{
+    static int supported = -1;
+    if (supported < 0)
+    {
+        supported = 0;
+
+        long page_size = sysconf(_SC_PAGESIZE);
+        void *page = mmap(nullptr, page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        int fd = open("/proc/self/pagemap", O_RDONLY);
+
+        if (page != MAP_FAILED && fd >= 0)
+        {
+            *static_cast<volatile uint8_t *>(page) = 1;
+
+            uint64_t entry = 0;
+            off_t offset = (reinterpret_cast<uintptr_t>(page) / page_size) * sizeof(entry);
+            if (pread(fd, &entry, sizeof(entry), offset) == sizeof(entry))
+            {
+                supported = (entry & PM_SOFT_DIRTY) != 0;
+            }
+        }
+
+        if (fd >= 0) close(fd);
+        if (page != MAP_FAILED) munmap(page, page_size);
+    }
+    return supported;
+}
+
+uint64_t ProcUtil::ClearSoftDirty(pid_t pid)
+{
+    if (!soft_dirty_supported())
+    {
+        return 0;
+    }
+
+    int fd = open(("/proc/"+std::to_string(pid)+"/clear_refs").c_str(), O_WRONLY);
+    if (fd < 0)
+    {
+        return 0;
+    }
+
+    bool ok = write(fd, "4", 1) == 1;
+    close(fd);
+
+    if (!ok)
+    {
+        return 0;
+    }
+
+    std::scoped_lock lk { generations_mut };
+    return generations[pid] = ++last_generation;
+}
+
+const std::vector<uintptr_t> &ProcUtil::IncrementalQuery::Run()
+{
+    if (!m_pattern.Valid())
+    {
+        m_hits.clear();
+        return m_hits;
+    }
+
+    m_was_incremental = m_primed && m_generation == current_generation(m_pid) && incremental_scan();
+
+    if (!m_was_incremental)
+    {
+        full_scan();
+    }
+    return m_hits;
+}
+
+void ProcUtil::IncrementalQuery::full_scan()
+{
+    // Clear before reading, anything written while we scan shows up as dirty next time
+    m_generation = ClearSoftDirty(m_pid);
+    m_primed = m_generation != 0;
+
+    m_hits.clear();
+    QueryMemory(m_pid, m_pattern, m_hits, m_alignment);
+}
+
+bool ProcUtil::IncrementalQuery::incremental_scan()
+{
+    int fd = open(("/proc/"+std::to_string(m_pid)+"/pagemap").c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    const size_t query_size = m_pattern.Size();
+
+    // [start, end) ranges of current readable memory and of the dirty runs
+    std::vector<std::pair<uintptr_t, uintptr_t>> regions;
+    std::vector<std::pair<uintptr_t, uintptr_t>> dirty;
+    std::vector<uint64_t> entries;
+    size_t total_pages = 0, dirty_pages = 0;
+
+    for (auto &region : GetPages(m_pid))
+    {
+        if (!IsScannable(region))
+        {
+            continue;
+        }
+
+        size_t page_count = (region.end - region.start) / page_size;
+        entries.resize(page_count);
+
+        ssize_t want = page_count * sizeof(uint64_t);
+        if (pread(fd, entries.data(), want, (region.start / page_size) * sizeof(uint64_t)) != want)
+        {
+            close(fd);
+            return false;
+        }
+
+        regions.emplace_back(region.start, region.end);
+        total_pages += page_count;
+
+        for (size_t i = 0; i < page_count; )
+        {
+            if (!(entries[i] & PM_SOFT_DIRTY))
+            {
+                i++;
+                continue;
+            }
+            size_t first = i;
+            while (i < page_count && (entries[i] & PM_SOFT_DIRTY))
+            {
+                i++;
+            }
+            dirty.emplace_back(region.start + first * page_size, region.start + i * page_size);
+            dirty_pages += i - first;
+        }
+    }
+    close(fd);
+
+    if (dirty_pages * DIRTY_FULL_SCAN_DIVISOR > total_pages)
+    {
+        return false;
+    }
+
+    // A match can start up to query_size - 1 bytes before a dirty page and still overlap it,
+    // so every dirty run is re-scanned from there on. `rescanned` holds the start ranges covered.
+    std::vector<std::pair<uintptr_t, uintptr_t>> rescanned;
+    std::vector<uintptr_t> fresh;
+    std::vector<uint8_t> buf;
+
+    size_t region_index = 0;
+    for (auto &[start, end] : dirty)
+    {
+        while (regions[region_index].second <= start)
+        {
+            region_index++;
+        }
+        auto &region = regions[region_index];
+
+        uintptr_t from = std::max(region.first, start - std::min<uintptr_t>(start, query_size - 1));
+        uintptr_t to = std::min(region.second, end + query_size - 1);
+
+        if (!rescanned.empty() && rescanned.back().second >= from)
+        {
+            rescanned.back().second = end;
+        }
+        else
+        {
+            rescanned.emplace_back(from, end);
+        }
+
+        buf.resize(to - from);
+        ssize_t bytes_read = ReadMemoryBytes(m_pid, from, buf.data(), buf.size());
+        if (bytes_read <= 0)
+        {
+            continue;
+        }
+
+        m_pattern.FindAll(buf.data(), bytes_read, 1, [&] (size_t offset)
+        {
+            uintptr_t address = from + offset;
+            if (address >= end)
+            {
+                return false;
+            }
+            if (address % m_alignment == 0 && (fresh.empty() || fresh.back() < address))
+            {
+                fresh.push_back(address);
+            }
+            return true;
+        });
+    }
+
+    // Merge: cached hits that are still mapped and weren't re-scanned, plus the fresh ones
+    std::vector<uintptr_t> hits;
+    hits.reserve(m_hits.size() + fresh.size());
+
+    size_t r = 0, d = 0;
+    for (uintptr_t hit : m_hits)
+    {
+        while (r < regions.size() && regions[r].second <= hit)
+        {
+            r++;
+        }
+        while (d < rescanned.size() && rescanned[d].second <= hit)
+        {
+            d++;
+        }
+
+        bool mapped = r < regions.size() && regions[r].first <= hit && hit + query_size <= regions[r].second;
+        bool stale = d < rescanned.size() && rescanned[d].first <= hit;
+
+        if (mapped && !stale)
+        {
+            hits.push_back(hit);
+        }
+    }
+
+    size_t cached = hits.size();
+    hits.insert(hits.end(), fresh.begin(), fresh.end());
+    std::inplace_merge(hits.begin(), hits.begin() + cached, hits.end());
+
+    m_hits = std::move(hits);
+    return true;
+}
@@ -0,0 +1,62 @@
+#ifndef INCREMENTAL_QUERY_H
+#define INCREMENTAL_QUERY_H
+
+#include <cstdint>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "compiled_pattern.h"
+
+namespace ProcUtil
+{
+    // A query that is run repeatedly against the same process. A full scan clears the soft-dirty
+    // bits of the process before reading, following runs only re-read the pages written since,
+    // using /proc/<pid>/pagemap. Hits in clean pages are kept from cache.
+    //
+    // The bits are only ever cleared right before a full scan: reading them and clearing them
+    // again can't be done atomically, a page written in between would be missed for good.
+    // Dirty pages pile up instead until re-reading them costs about as much as a full scan.
+    //
+    // Clearing soft-dirty is process wide, if anything else clears it in between (another
+    // IncrementalQuery on the same pid) the next run is a full scan again.
+    class IncrementalQuery
+    {
+    public:
+        IncrementalQuery(pid_t pid, const CompiledPattern &pattern, uint32_t alignment = 1) :
+            m_pid(pid), m_pattern(pattern), m_alignment(alignment ? alignment : 1)
+        {
+        }
+
+        // Sorted hits after this run
+        const std::vector<uintptr_t> &Run();
+
+        inline const std::vector<uintptr_t> &Hits() const { return m_hits; }
+        inline pid_t Pid() const { return m_pid; }
+
+        // True if the last Run() only re-read dirty pages
+        inline bool WasIncremental() const { return m_was_incremental; }
+
+        // Forces a full scan on the next run
+        inline void Reset() { m_primed = false; }
+
+    private:
+        void full_scan();
+        bool incremental_scan();
+
+        pid_t m_pid;
+        CompiledPattern m_pattern;
+        uint32_t m_alignment;
+
+        std::vector<uintptr_t> m_hits;
+
+        bool m_primed = false;
+        bool m_was_incremental = false;
+        uint64_t m_generation = 0;
+    };
+
+    // Clears the soft-dirty bits of every page of pid, returns the new clear generation or 0 on failure
+    uint64_t ClearSoftDirty(pid_t pid);
+};
+
+#endif /* INCREMENTAL_QUERY_H */
@@ -0,0 +1,113 @@
+#include "ipc_stats.h"
+
+#include <algorithm>
+#include <cmath>
+
+static size_t bucket_of(uint64_t ns)
+{
+    ns = std::min<uint64_t>(ns, (2ULL << IpcStats::MAX_EXPONENT) - 1);
+    if (ns < (1ULL << IpcStats::SUB_BUCKET_BITS))
+    {
+        return ns;
+    }
+
+    uint32_t exponent = 63 - __builtin_clzll(ns);
+    uint32_t shift = exponent - IpcStats::SUB_BUCKET_BITS;
+    size_t sub_bucket = (ns >> shift) & ((1ULL << IpcStats::SUB_BUCKET_BITS) - 1);
+    return (shift + 1) << IpcStats::SUB_BUCKET_BITS | sub_bucket;
+}
+
+static uint64_t bucket_start(size_t bucket)
+{
+    size_t group = bucket >> IpcStats::SUB_BUCKET_BITS;
+    if (!group)
+    {
+        return bucket;
+    }
+    uint64_t sub_bucket = bucket & ((1ULL << IpcStats::SUB_BUCKET_BITS) - 1);
+    return ((1ULL << IpcStats::SUB_BUCKET_BITS) + sub_bucket) << (group - 1);
+}
+
+void IpcStats::Histogram::Record(uint64_t ns)
+{
+    min = count ? std::min(min, ns) : ns;
+    max = std::max(max, ns);
+    sum += ns;
+    count++;
+    buckets[bucket_of(ns)]++;
+}
+
+uint64_t IpcStats::Histogram::Percentile(double fraction) const
+{
+    if (!count)
+    {
+        return 0;
+    }
+
+    uint64_t rank = std::max<uint64_t>(1, std::ceil(fraction * count));
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS; i++)
+    {
+        seen += buckets[i];
+        if (seen >= rank)
+        {
+            return std::clamp(bucket_start(i), min, max);
+        }
+    }
+    return max;
+}
+
+void IpcStats::Record(MessageType type, const ShmRing::Timing &timing, uint64_t observed, bool failed)
+{
+    if (type >= MessageType::NONE)
+    {
+        return;
+    }
+
+    // A stage whose stamps are missing or out of order is left out rather than counted as 0
+    uint64_t points[] = { timing.submitted, timing.taken, timing.started, timing.finished, observed };
+
+    std::scoped_lock lk { m_mut };
+    auto &stats = m_types[static_cast<size_t>(type)];
+
+    stats.answered++;
+    if (failed)
+    {
+        stats.failed++;
+    }
+
+    for (int stage = QUEUED; stage <= REPLY; stage++)
+    {
+        if (points[stage] && points[stage + 1] >= points[stage])
+        {
+            stats.stages[stage].Record(points[stage + 1] - points[stage]);
+        }
+    }
+    if (timing.submitted && observed >= timing.submitted)
+    {
+        stats.stages[TOTAL].Record(observed - timing.submitted);
+    }
+}
+
+void IpcStats::RecordTimeout(MessageType type)
+{
+    if (type >= MessageType::NONE)
+    {
+        return;
+    }
+
+    std::scoped_lock lk { m_mut };
+    m_types[static_cast<size_t>(type)].timeouts++;
+}
+
+std::vector<IpcStats::TypeStats> IpcStats::Snapshot() const
+{
+    std::scoped_lock lk { m_mut };
+    return { m_types.begin(), m_types.end() };
+}
+
+void IpcStats::Reset()
+{
+    std::scoped_lock lk { m_mut };
+    std::fill(m_types.begin(), m_types.end(), TypeStats { });
+}
@@ -0,0 +1,69 @@
+#ifndef IPC_STATS_H
+#define IPC_STATS_H
+
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+#include "protocol.h"
+
+// Where the time of flash commands goes, per message type. Each answered command adds one value
+// per stage to a log-linear histogram in the HDR style: exact below 16ns, then 16 buckets per
+// power of two, so any value is known within about 6%.
+class IpcStats
+{
+public:
+    enum Stage
+    {
+        QUEUED,         // submitted until do_lib's ipc thread took it
+        SCHEDULED,      // taken until its work started, the wait for the next game tick for game commands
+        RUN,            // the work itself, the AS3 calls
+        REPLY,          // answered until the client noticed
+        TOTAL,          // submitted until the client noticed
+
+        STAGE_COUNT
+    };
+
+    static constexpr uint32_t SUB_BUCKET_BITS = 4;
+    // Longer values land in the last bucket, about 137s
+    static constexpr uint32_t MAX_EXPONENT = 36;
+    static constexpr size_t BUCKETS = (MAX_EXPONENT - SUB_BUCKET_BITS + 2) << SUB_BUCKET_BITS;
+
+    static constexpr size_t TYPES = static_cast<size_t>(MessageType::NONE);
+
+    struct Histogram
+    {
+        uint64_t count = 0;
+        uint64_t sum = 0;
+        uint64_t min = 0;
+        uint64_t max = 0;
+        std::array<uint32_t, BUCKETS> buckets { };
+
+        void Record(uint64_t ns);
+        // Lower bound of the bucket holding the value at `fraction` of the count, 0 if empty
+        uint64_t Percentile(double fraction) const;
+    };
+
+    struct TypeStats
+    {
+        uint64_t answered = 0;
+        uint64_t failed = 0;        // answered with an error, do_lib's own timeouts included
+        uint64_t timeouts = 0;      // given up on by the client
+        std::array<Histogram, STAGE_COUNT> stages;
+    };
+
+    // `observed` is when the client saw the slot DONE, in ShmRing::Now() ns
+    void Record(MessageType type, const ShmRing::Timing &timing, uint64_t observed, bool failed);
+    void RecordTimeout(MessageType type);
+
+    // Indexed by message type
+    std::vector<TypeStats> Snapshot() const;
+    void Reset();
+
+private:
+    mutable std::mutex m_mut;
+    std::array<TypeStats, TYPES> m_types;
+};
+
+#endif /* IPC_STATS_H */
@@ -0,0 +1,150 @@
+#include "pointer_index.h"
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+
+#include "proc_util.h"
+
+// Work is handed out in pieces of this size so big mappings are spread between threads
+#define INDEX_CHUNK_SIZE (4 * 1024 * 1024)
+
+typedef std::pair<uintptr_t, uintptr_t> Range;
+
+static bool is_heap(const ProcUtil::MemPage &page)
+{
+    return page.read == 'r' && page.write == 'w' && (page.name.empty() || page.name == "[heap]");
+}
+
+size_t ProcUtil::PointerIndex::Build(pid_t pid, unsigned threads)
+{
+    std::vector<Range> heap;
+    for (auto &page : GetPages(pid))
+    {
+        if (!is_heap(page))
+        {
+            continue;
+        }
+        // Adjacent anonymous mappings are common, fewer ranges means a cheaper lookup
+        if (!heap.empty() && heap.back().second == page.start)
+        {
+            heap.back().second = page.end;
+        }
+        else
+        {
+            heap.emplace_back(page.start, page.end);
+        }
+    }
+
+    std::vector<Range> chunks;
+    for (auto &[start, end] : heap)
+    {
+        for (uintptr_t p = start; p < end; p += INDEX_CHUNK_SIZE)
+        {
+            chunks.emplace_back(p, std::min<uintptr_t>(end, p + INDEX_CHUNK_SIZE));
+        }
+    }
+
+    if (!threads)
+    {
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    threads = std::max<size_t>(1, std::min<size_t>(threads, chunks.size()));
+
+    const uintptr_t lowest = heap.empty() ? 0 : heap.front().first;
+    const uintptr_t highest = heap.empty() ? 0 : heap.back().second;
+
+    std::atomic<size_t> next_chunk { 0 };
+    std::vector<std::vector<Entry>> results(threads);
+    std::vector<std::thread> workers;
+
+    for (unsigned t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]
+        {
+            auto &out = results[t];
+            std::vector<uintptr_t> buf(INDEX_CHUNK_SIZE / sizeof(uintptr_t));
+
+            for (size_t i; (i = next_chunk++) < chunks.size(); )
+            {
+                auto [start, end] = chunks[i];
+                ssize_t bytes_read = ReadMemoryBytes(pid, start, buf.data(), end - start);
+                if (bytes_read <= 0)
+                {
+                    continue;
+                }
+
+                size_t count = bytes_read / sizeof(uintptr_t);
+                for (size_t j = 0; j < count; j++)
+                {
+                    // Atoms keep their kind in the low 3 bits, index them by the object they point to
+                    uintptr_t value = buf[j] & ~uintptr_t(7);
+                    if (value < lowest || value >= highest)
+                    {
+                        continue;
+                    }
+
+                    auto it = std::upper_bound(heap.begin(), heap.end(), value, [] (uintptr_t v, const Range &r)
+                    {
+                        return v < r.first;
+                    });
+                    if (it != heap.begin() && value < (--it)->second)
+                    {
+                        out.push_back({ value, start + j * sizeof(uintptr_t) });
+                    }
+                }
+            }
+            std::sort(out.begin(), out.end());
+        });
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    // Merge the sorted per thread results
+    std::vector<Entry> entries;
+    size_t total = 0;
+    for (auto &r : results)
+    {
+        total += r.size();
+    }
+    entries.reserve(total);
+
+    for (auto &r : results)
+    {
+        size_t middle = entries.size();
+        entries.insert(entries.end(), r.begin(), r.end());
+        std::inplace_merge(entries.begin(), entries.begin() + middle, entries.end());
+        std::vector<Entry>().swap(r);
+    }
+
+    m_pid = pid;
+    m_entries = std::move(entries);
+    return m_entries.size();
+}
+
+void ProcUtil::PointerIndex::Clear()
+{
+    m_pid = -1;
+    std::vector<Entry>().swap(m_entries);
+}
+
+std::vector<uintptr_t> ProcUtil::PointerIndex::Referrers(uintptr_t target) const
+{
+    std::vector<uintptr_t> result;
+    for (auto &entry : Referrers(target, target + 1))
+    {
+        result.push_back(entry.source);
+    }
+    return result;
+}
+
+std::vector<ProcUtil::PointerIndex::Entry> ProcUtil::PointerIndex::Referrers(uintptr_t start, uintptr_t end) const
+{
+    auto first = std::lower_bound(m_entries.begin(), m_entries.end(), Entry { start, 0 });
+    auto last = std::lower_bound(first, m_entries.end(), Entry { end, 0 });
+    return std::vector<Entry>(first, last);
+}
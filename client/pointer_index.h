@@ -0,0 +1,48 @@
+#ifndef POINTER_INDEX_H
+#define POINTER_INDEX_H
+
+#include <cstdint>
+#include <vector>
+
+#include <sys/types.h>
+
+namespace ProcUtil
+{
+    // Reverse index of the heap: every aligned 8 byte value stored in a rw anonymous mapping
+    // that points into another rw anonymous mapping, sorted by target. Answers "who references X".
+    // Atom kind bits are stripped, so tagged references (e.g. Array elements) are found too.
+    class PointerIndex
+    {
+    public:
+        struct Entry
+        {
+            uintptr_t target;
+            uintptr_t source;
+
+            bool operator<(const Entry &other) const
+            {
+                return target < other.target || (target == other.target && source < other.source);
+            }
+        };
+
+        // Rebuilds the whole index in one pass over memory, threads = 0 uses every core
+        size_t Build(pid_t pid, unsigned threads = 0);
+
+        void Clear();
+
+        // Addresses holding a pointer to exactly `target`
+        std::vector<uintptr_t> Referrers(uintptr_t target) const;
+
+        // Entries whose target is in [start, end), e.g. anything pointing inside an object
+        std::vector<Entry> Referrers(uintptr_t start, uintptr_t end) const;
+
+        inline pid_t Pid() const { return m_pid; }
+        inline size_t Size() const { return m_entries.size(); }
+
+    private:
+        pid_t m_pid = -1;
+        std::vector<Entry> m_entries;
+    };
+};
+
+#endif /* POINTER_INDEX_H */
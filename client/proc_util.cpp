@@ -1,13 +1,27 @@
 #include "proc_util.h"
+#include "maps_parser.h"
+#include "region_table.h"
 #include <algorithm>
 #include <fstream>
 #include <filesystem>
 
+#include <cerrno>
+#include <climits>
 #include <cstring>
 
+#include <fcntl.h>
 #include <sys/uio.h>
 #include <unistd.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define SCAN_CHUNK_SIZE (16 * 1024 * 1024)
+
+// Upper bound on the hits StreamQuery holds before handing them out
+#define STREAM_BATCH_SIZE 0x10000
+
 bool ProcUtil::IsChildOf(pid_t child_pid, pid_t test_parent)
 {
     auto pid = child_pid;
@@ -69,6 +83,48 @@ std::vector<int> ProcUtil::FindProcsByName(const std::string &pattern)
     return result;
 }
 
+bool ProcUtil::GetDescendants(pid_t pid, std::vector<pid_t> &out)
+{
+    std::error_code ec;
+    std::filesystem::directory_iterator tasks("/proc/"+std::to_string(pid)+"/task", ec);
+    if (ec)
+    {
+        // Gone already, there is nothing below it
+        return true;
+    }
+
+    // Threads exit while we walk, the non-throwing increment just ends the listing early
+    for (auto task = std::filesystem::begin(tasks); !ec && task != std::filesystem::end(tasks); task.increment(ec))
+    {
+        auto children_path = task->path() / "children";
+        std::ifstream children_f { children_path };
+        if (!children_f)
+        {
+            // Only a live task without the file means a kernel built without CONFIG_PROC_CHILDREN,
+            // otherwise it exited since it was listed. The file is checked first so a task that
+            // exits in between reads as gone.
+            std::error_code exists_ec;
+            if (!std::filesystem::exists(children_path, exists_ec) && std::filesystem::exists(task->path(), exists_ec))
+            {
+                return false;
+            }
+            continue;
+        }
+
+        // Children of every thread of the process, space separated
+        pid_t child;
+        while (children_f >> child)
+        {
+            out.push_back(child);
+            if (!GetDescendants(child, out))
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
 bool ProcUtil::ProcessExists(pid_t pid)
 {
     return std::filesystem::exists("/proc/"+std::to_string(pid));
@@ -91,119 +147,543 @@ size_t ProcUtil::WriteMemoryBytes(pid_t pid, uintptr_t address, void *dest, uint
 
 std::vector<ProcUtil::MemPage> ProcUtil::GetPages(pid_t pid, const std::string &name)
 {
+    auto table = RegionTable::Get(pid);
+    if (!table)
+    {
+        return { };
+    }
+
+    if (name.empty())
+    {
+        return table->Pages();
+    }
+
     std::vector<MemPage> pages;
+    for (auto &page : table->Pages())
+    {
+        if (page.name.find(name) != std::string::npos)
+        {
+            pages.push_back(page);
+        }
+    }
+    return pages;
+}
+
+bool ProcUtil::IsMapped(pid_t pid, const std::string &name)
+{
+    auto table = RegionTable::Get(pid);
+    if (!table)
+    {
+        return false;
+    }
+
+    return std::any_of(table->Pages().begin(), table->Pages().end(), [&] (const MemPage &page)
+    {
+        return page.name.find(name) != std::string::npos;
+    });
+}
+
+uint64_t ProcUtil::GetMemoryUsage(pid_t pid)
+{
+    ProcessStats stats;
+    return GetProcessStats(pid, stats) ? stats.rss : 0;
+}
+
+// Reads a whole small procfs file into buf, returns its length or -1
+static ssize_t read_proc_file(const char *path, char *buf, size_t size)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return -1;
+    }
+    ssize_t n = read(fd, buf, size - 1);
+    close(fd);
+
+    if (n >= 0)
+    {
+        buf[n] = 0;
+    }
+    return n;
+}
+
+bool ProcUtil::GetProcessStats(pid_t pid, ProcessStats &out)
+{
+    char path[64];
+    char buf[16384];
 
-    if (std::ifstream fi{"/proc/"+std::to_string(pid)+"/maps"})
+    snprintf(path, sizeof(path), "/proc/%d/stat", pid);
+    if (read_proc_file(path, buf, sizeof(buf)) <= 0)
     {
-        std::string line, filename;
-        uintptr_t size;
-        uintptr_t start, end;
-        char read, write, exec, cow, _;
-        uint32_t offset, dev_major, dev_minor, inode;
+        return false;
+    }
 
-        while (std::getline(fi, line))
+    // comm can contain spaces and parentheses, the fields start after the last ')'
+    const char *p = strrchr(buf, ')');
+    if (!p)
+    {
+        return false;
+    }
+
+    // Field 3 (state) onwards, we want minflt(10) majflt(12) utime(14) stime(15) rss(24)
+    uint64_t fields[25] = { 0 };
+    char *end = const_cast<char *>(p + 2);
+    for (int field = 3; field <= 24 && *end; field++)
+    {
+        char *next;
+        fields[field] = strtoull(end, &next, 10);
+        if (next == end)
+        {
+            // state is a letter
+            next = end + 1;
+        }
+        end = next;
+        while (*end == ' ') end++;
+    }
+
+    static const long ticks_per_sec = sysconf(_SC_CLK_TCK);
+    static const long page_size_kb = sysconf(_SC_PAGE_SIZE) / 1024;
+
+    out.minflt = fields[10];
+    out.majflt = fields[12];
+    out.cpu_ms = (fields[14] + fields[15]) * 1000 / ticks_per_sec;
+    out.rss = fields[24] * page_size_kb;
+    out.voluntary_ctxt = 0;
+    out.nonvoluntary_ctxt = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/status", pid);
+    if (read_proc_file(path, buf, sizeof(buf)) > 0)
+    {
+        static const char voluntary[] = "\nvoluntary_ctxt_switches:";
+        static const char nonvoluntary[] = "\nnonvoluntary_ctxt_switches:";
+
+        if (const char *v = strstr(buf, voluntary))
+            out.voluntary_ctxt = strtoull(v + sizeof(voluntary) - 1, nullptr, 10);
+        if (const char *v = strstr(buf, nonvoluntary))
+            out.nonvoluntary_ctxt = strtoull(v + sizeof(nonvoluntary) - 1, nullptr, 10);
+    }
+    return true;
+}
+
+static ProcUtil::MappingClass classify_mapping(const MapsParser::Region &region)
+{
+    std::string_view name = region.name;
+
+    if (name.empty() || name == "[heap]" || name.compare(0, 6, "[anon:") == 0)
+    {
+        return region.exec == 'x' ? ProcUtil::MAPPING_JIT : ProcUtil::MAPPING_HEAP;
+    }
+    if (name[0] != '/')
+    {
+        return ProcUtil::MAPPING_OTHER;
+    }
+    if (region.exec == 'x' && name.find("libpepflashplayer") != std::string_view::npos)
+    {
+        return ProcUtil::MAPPING_FLASH_CODE;
+    }
+    return ProcUtil::MAPPING_FILES;
+}
+
+// The MemoryUsage member a "Name:   123 kB" line of smaps goes to, if any
+static uint64_t ProcUtil::MemoryUsage::*smaps_field(std::string_view key)
+{
+    if (key == "Rss") return &ProcUtil::MemoryUsage::rss;
+    if (key == "Pss") return &ProcUtil::MemoryUsage::pss;
+    if (key == "Anonymous") return &ProcUtil::MemoryUsage::anonymous;
+    if (key == "Swap") return &ProcUtil::MemoryUsage::swap;
+    return nullptr;
+}
+
+// Sums every mapping of an smaps style file into `total` and, if `classes` is given, into its class
+static bool read_smaps(const char *path, ProcUtil::MemoryUsage &total, ProcUtil::MemoryUsage *classes)
+{
+    thread_local MapsParser parser;
+    if (!parser.ReadFile(path))
+    {
+        return false;
+    }
+
+    total = { };
+    if (classes)
+    {
+        std::fill(classes, classes + ProcUtil::MAPPING_CLASS_COUNT, ProcUtil::MemoryUsage { });
+    }
+
+    auto raw = parser.Raw();
+    const char *p = raw.data();
+    const char *end = p + raw.size();
+
+    ProcUtil::MemoryUsage *current = nullptr;
+    bool any = false;
+
+    while (p < end)
+    {
+        const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+        if (!eol)
+        {
+            eol = end;
+        }
+
+        // Field names start with a capital, mapping headers with an address in lowercase hex
+        if (*p >= 'A' && *p <= 'Z')
         {
-            filename.resize(line.size());
-            if (sscanf(line.c_str(), "%lx-%lx %c%c%c%c %x %x:%x %u %[^\n]",
-                &start, &end,
-                &read,&write, &exec, &cow,
-                &offset,
-                &dev_major, &dev_minor,
-                &inode, &filename[0]) >= 6)
+            const char *colon = static_cast<const char *>(memchr(p, ':', eol - p));
+            auto field = colon ? smaps_field(std::string_view(p, colon - p)) : nullptr;
+            if (field)
             {
-                if (name.length() && filename.find(name) == std::string::npos)
+                const char *v = colon + 1;
+                while (v < eol && *v == ' ') v++;
+
+                uint64_t value = 0;
+                for (; v < eol && *v >= '0' && *v <= '9'; v++)
+                {
+                    value = value * 10 + (*v - '0');
+                }
+
+                total.*field += value;
+                if (current)
                 {
-                    continue;
+                    current->*field += value;
                 }
-                pages.emplace_back(start, end, read, write, exec, cow, offset, size, filename);
             }
         }
+        else
+        {
+            MapsParser::Region region;
+            if (MapsParser::ParseLine(p, eol, region))
+            {
+                current = classes ? &classes[classify_mapping(region)] : nullptr;
+                any = true;
+            }
+        }
+        p = eol + 1;
+    }
+    return any;
+}
+
+bool ProcUtil::GetMemoryRollup(pid_t pid, MemoryUsage &out)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/smaps_rollup", pid);
+    if (read_smaps(path, out, nullptr))
+    {
+        return true;
     }
+
+    // Kernels before 4.14
+    snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+    return read_smaps(path, out, nullptr);
+}
+
+bool ProcUtil::GetMemoryBreakdown(pid_t pid, MemoryBreakdown &out)
+{
+    char path[64];
+    snprintf(path, sizeof(path), "/proc/%d/smaps", pid);
+    return read_smaps(path, out.total, out.classes);
+}
+
+std::vector<ProcUtil::MemPage> ProcUtil::GetScannablePages(pid_t pid, const std::string &area)
+{
+    auto pages = GetPages(pid, area);
+    pages.erase(std::remove_if(pages.begin(), pages.end(), [] (const MemPage &page)
+    {
+        return !IsScannable(page);
+    }), pages.end());
     return pages;
 }
 
-uint64_t ProcUtil::GetMemoryUsage(pid_t pid)
+bool ProcUtil::ReadChunks(pid_t pid, const std::vector<MemPage> &regions, size_t overlap, const ChunkCallback &fn)
 {
-    if (std::ifstream fi { "/proc/"+std::to_string(pid)+"/stat" })
+    // Keep every chunk start 64 byte aligned so aligned scans can use chunk offsets directly
+    overlap = (overlap + 63) & ~size_t(63);
+
+    std::vector<uint8_t> buf(std::max<size_t>(SCAN_CHUNK_SIZE, overlap * 2));
+    size_t step = buf.size() - overlap;
+
+    for (auto &region : regions)
     {
-        std::string _pid, comm, state, ppid, pgrp, session, tty_nr;
-        std::string tpgid, flags, minflt, cminflt, majflt, cmajflt;
-        std::string utime, stime, cutime, cstime, priority, nice;
-        std::string O, itrealvalue, starttime;
+        for (uintptr_t address = region.start; address < region.end; address += step)
+        {
+            size_t size = std::min<uintptr_t>(buf.size(), region.end - address);
+            bool last = address + size >= region.end;
 
-        // the two fields we want
-        uint64_t vsize;
-        int64_t rss;
+            ssize_t bytes_read = ReadMemoryBytes(pid, address, buf.data(), size);
+            if (bytes_read < 0 && errno == ESRCH)
+            {
+                return false;
+            }
 
-        fi >> _pid >> comm >> state >> ppid >> pgrp >> session >> tty_nr
-                    >> tpgid >> flags >> minflt >> cminflt >> majflt >> cmajflt
-                    >> utime >> stime >> cutime >> cstime >> priority >> nice
-                    >> O >> itrealvalue >> starttime >> vsize >> rss; // don't care about the rest
+            MemChunk chunk { address, buf.data(), 0, last ? size : step, address == region.start ? 0 : overlap };
+            if (bytes_read <= 0)
+            {
+                // Skip the rest of the region
+                chunk.advanced = region.end - address;
+                last = true;
+            }
+            else
+            {
+                chunk.size = bytes_read;
+            }
 
-        int64_t page_size_kb = sysconf(_SC_PAGE_SIZE) / 1024; // in case x86-64 is configured to use 2MB pages
-        auto vm_usage     = vsize / 1024;
-        auto resident_set = rss * page_size_kb;
-        return resident_set;
+            if (!fn(chunk))
+            {
+                return false;
+            }
+            if (last)
+            {
+                break;
+            }
+        }
     }
-    return 0;
+    return true;
+}
+
+template <typename F>
+static void scan_memory(pid_t pid, const CompiledPattern &pattern, uint32_t alignment, const std::string &area, F on_match)
+{
+    if (!pattern.Valid())
+        return;
+
+    ProcUtil::ReadChunks(pid, ProcUtil::GetScannablePages(pid, area), pattern.Size() - 1, [&] (const ProcUtil::MemChunk &chunk)
+    {
+        return pattern.FindAll(chunk.data, chunk.size, alignment, [&] (size_t offset)
+        {
+            return chunk.Seen(offset, pattern.Size()) || on_match(chunk.address + offset);
+        });
+    });
 }
 
 int ProcUtil::QueryMemory(pid_t pid, unsigned char *query, const char *mask, uintptr_t *out, uint32_t amount)
 {
-    uint32_t finds = 0,
-        alignment= 1;
+    return QueryMemory(pid, CompiledPattern(query, mask, strlen(mask)), out, amount);
+}
 
-    size_t query_size = strlen(mask);
+int ProcUtil::QueryMemory(pid_t pid, const CompiledPattern &pattern, uintptr_t *out, uint32_t amount, const std::string &area)
+{
+    uint32_t finds = 0;
+
+    if (!amount)
+        return 0;
 
-    for (auto &region : GetPages(pid))
+    scan_memory(pid, pattern, 1, area, [&] (uintptr_t address)
     {
-        size_t size = region.end - region.start;
-        if (query_size > size)
-            continue;
+        out[finds++] = address;
+        return finds != amount;
+    });
 
-        std::vector<uint8_t> buf(size);
+    return finds;
+}
 
-        ssize_t bytes_read = ReadMemoryBytes(pid, region.start, buf.data(), size);
+size_t ProcUtil::StreamQuery(pid_t pid, const CompiledPattern &pattern, const ResultCallback &fn, uint32_t alignment, const std::string &area)
+{
+    size_t delivered = 0;
+    bool more = true;
 
-        if (bytes_read < static_cast<ssize_t>(query_size))
-            continue;
+    if (!pattern.Valid())
+        return 0;
 
-        for (size_t i = 0 ; finds != amount && i < (bytes_read - query_size) ; i+=alignment)
+    std::vector<uintptr_t> batch;
+
+    auto flush = [&]
+    {
+        if (!batch.empty())
         {
-            bool found = true;
-            for (uintptr_t j = 0; j < query_size && found; j++)
-                found &= (buf[i + j] == query[j]) | (mask[j] == '?');
-            if (found)
-                out[finds++] = region.start + i;
+            more = fn(batch.data(), batch.size());
+            delivered += batch.size();
+            batch.clear();
+        }
+        return more;
+    };
+
+    ReadChunks(pid, GetScannablePages(pid, area), pattern.Size() - 1, [&] (const MemChunk &chunk)
+    {
+        pattern.FindAll(chunk.data, chunk.size, std::max(alignment, 1u), [&] (size_t offset)
+        {
+            if (chunk.Seen(offset, pattern.Size()))
+            {
+                return true;
+            }
+            batch.push_back(chunk.address + offset);
+            return batch.size() < STREAM_BATCH_SIZE || flush();
+        });
+
+        return flush();
+    });
+
+    return delivered;
+}
+
+size_t ProcUtil::QueryMemory(pid_t pid, const uint8_t *query, const char *mask, std::vector<uintptr_t> &out, uint32_t alignment)
+{
+    return QueryMemory(pid, CompiledPattern(query, mask, strlen(mask)), out, alignment);
+}
+
+size_t ProcUtil::QueryMemory(pid_t pid, const CompiledPattern &pattern, std::vector<uintptr_t> &out, uint32_t alignment, const std::string &area)
+{
+    size_t before = out.size();
+
+    scan_memory(pid, pattern, std::max(alignment, 1u), area, [&] (uintptr_t address)
+    {
+        out.push_back(address);
+        return true;
+    });
+
+    return out.size() - before;
+}
+
+// Calls on_match(offset) for every aligned int32 in [min, max], 16 values per round.
+// data must be 16 byte aligned, which chunk buffers are.
+template <typename F>
+static bool find_in_range(const uint8_t *data, size_t size, int32_t min, int32_t max, F on_match)
+{
+    const int32_t *values = reinterpret_cast<const int32_t *>(data);
+    size_t count = size / sizeof(int32_t);
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128i vmin = _mm_set1_epi32(min);
+    const __m128i vmax = _mm_set1_epi32(max);
+
+    for (; i + 16 <= count; i += 16)
+    {
+        uint32_t mask = 0;
+        for (size_t j = 0; j < 4; j++)
+        {
+            __m128i v = _mm_load_si128(reinterpret_cast<const __m128i *>(values + i + j * 4));
+            __m128i out = _mm_or_si128(_mm_cmplt_epi32(v, vmin), _mm_cmpgt_epi32(v, vmax));
+            mask |= (~_mm_movemask_ps(_mm_castsi128_ps(out)) & 0xf) << (j * 4);
+        }
+
+        for (; mask; mask &= mask - 1)
+        {
+            if (!on_match((i + __builtin_ctz(mask)) * sizeof(int32_t)))
+                return false;
         }
     }
-    return finds;
+#endif
+
+    for (; i < count; i++)
+    {
+        if (values[i] >= min && values[i] <= max && !on_match(i * sizeof(int32_t)))
+            return false;
+    }
+    return true;
 }
 
-uintptr_t ProcUtil::FindPattern(pid_t pid, const std::string &query, const std::string &segment)
+// Same for doubles, NaNs never match
+template <typename F>
+static bool find_in_range(const uint8_t *data, size_t size, double min, double max, F on_match)
 {
-    std::stringstream ss(query);
-    std::string data{ };
-    std::string mask{ };
-    std::vector<uint8_t> bytes;
-    uintptr_t result = 0;
+    const double *values = reinterpret_cast<const double *>(data);
+    size_t count = size / sizeof(double);
+    size_t i = 0;
+
+#ifdef __SSE2__
+    const __m128d vmin = _mm_set1_pd(min);
+    const __m128d vmax = _mm_set1_pd(max);
+
+    for (; i + 8 <= count; i += 8)
+    {
+        uint32_t mask = 0;
+        for (size_t j = 0; j < 4; j++)
+        {
+            __m128d v = _mm_load_pd(values + i + j * 2);
+            __m128d in = _mm_and_pd(_mm_cmpge_pd(v, vmin), _mm_cmple_pd(v, vmax));
+            mask |= _mm_movemask_pd(in) << (j * 2);
+        }
+
+        for (; mask; mask &= mask - 1)
+        {
+            if (!on_match((i + __builtin_ctz(mask)) * sizeof(double)))
+                return false;
+        }
+    }
+#endif
+
+    for (; i < count; i++)
+    {
+        if (values[i] >= min && values[i] <= max && !on_match(i * sizeof(double)))
+            return false;
+    }
+    return true;
+}
 
-    while (std::getline(ss, data, ' '))
+template <typename T>
+static size_t query_range(pid_t pid, T min, T max, std::vector<uintptr_t> &out, size_t amount, const std::string &area)
+{
+    size_t before = out.size();
+
+    // Values are aligned so none straddles two chunks, no overlap needed
+    ProcUtil::ReadChunks(pid, ProcUtil::GetScannablePages(pid, area), 0, [&] (const ProcUtil::MemChunk &chunk)
+    {
+        return find_in_range(chunk.data, chunk.size, min, max, [&] (size_t offset)
+        {
+            out.push_back(chunk.address + offset);
+            return !amount || out.size() - before < amount;
+        });
+    });
+
+    return out.size() - before;
+}
+
+size_t ProcUtil::QueryIntRange(pid_t pid, int32_t min, int32_t max, std::vector<uintptr_t> &out, size_t amount, const std::string &area)
+{
+    return query_range(pid, min, max, out, amount, area);
+}
+
+size_t ProcUtil::QueryDoubleRange(pid_t pid, double min, double max, std::vector<uintptr_t> &out, size_t amount, const std::string &area)
+{
+    return query_range(pid, min, max, out, amount, area);
+}
+
+size_t ProcUtil::ReadMemoryBatch(pid_t pid, const uintptr_t *addresses, size_t count, size_t size, uint8_t *out, bool *valid)
+{
+    std::vector<iovec> local(std::min<size_t>(count, IOV_MAX));
+    std::vector<iovec> remote(local.size());
+    size_t ok = 0;
+
+    for (size_t i = 0; i < count; )
     {
-        if (data.find('?') != std::string::npos)
+        size_t batch = std::min<size_t>(count - i, IOV_MAX);
+
+        for (size_t j = 0; j < batch; j++)
+        {
+            local[j] = { out + (i + j) * size, size };
+            remote[j] = { reinterpret_cast<void *>(addresses[i + j]), size };
+        }
+
+        ssize_t n = process_vm_readv(pid, local.data(), batch, remote.data(), batch, 0);
+
+        // process_vm_readv stops at the first remote iovec that faults, so everything
+        // before it is good, the faulting one is dropped and we resume right after it
+        size_t done = n > 0 ? static_cast<size_t>(n) / size : 0;
+
+        for (size_t j = 0; j < done; j++)
+            valid[i + j] = true;
+        ok += done;
+
+        if (done < batch)
         {
-            mask += "?";
-            bytes.push_back(0);
+            valid[i + done] = false;
+            i += done + 1;
         }
         else
         {
-            bytes.push_back(static_cast<uint8_t>(std::stoi(data, nullptr, 16)));
-            mask += "x";
+            i += batch;
         }
     }
+    return ok;
+}
 
-    QueryMemory(pid, &bytes.at(0), mask.c_str(), &result, 1);
+uintptr_t ProcUtil::FindPattern(pid_t pid, const std::string &query, const std::string &segment)
+{
+    return FindPattern(pid, CompiledPattern(query), segment);
+}
 
+uintptr_t ProcUtil::FindPattern(pid_t pid, const CompiledPattern &pattern, const std::string &segment)
+{
+    uintptr_t result = 0;
+    QueryMemory(pid, pattern, &result, 1, segment);
     return result;
 }
 
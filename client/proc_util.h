@@ -2,9 +2,12 @@
 #define PROC_UTIL_H
 
 #include <cstdint>
+#include <functional>
 #include <string>
 #include <vector>
 
+#include "compiled_pattern.h"
+
 namespace ProcUtil
 {
     struct MemPage
@@ -27,10 +30,34 @@ namespace ProcUtil
         std::string name;
     };
 
+    struct MemChunk
+    {
+        uintptr_t address;  // address of data[0], always 64 byte aligned
+        const uint8_t *data;
+        size_t size;        // 0 if the region couldn't be read
+        size_t advanced;    // bytes of the region this chunk accounts for, adds up to the region size
+        size_t overlap;     // leading bytes that were already at the end of the previous chunk
+
+        // Whether something `length` bytes long at `offset` was already whole in the previous chunk
+        inline bool Seen(size_t offset, size_t length) const
+        {
+            return offset + length <= overlap;
+        }
+    };
+
+    typedef std::function<bool(const MemChunk &)> ChunkCallback;
+
+    // Receives scan hits in batches, returning false stops the scan
+    typedef std::function<bool(const uintptr_t *addresses, size_t count)> ResultCallback;
+
     bool IsChildOf(pid_t child_pid, pid_t test_parent);
 
     std::vector<int> FindProcsByName(const std::string &n);
 
+    // Appends every process below pid by following /proc/<pid>/task/<tid>/children,
+    // returns false if the kernel doesn't provide those lists
+    bool GetDescendants(pid_t pid, std::vector<pid_t> &out);
+
     bool ProcessExists(pid_t pid);
 
     size_t ReadMemoryBytes(pid_t pid, uintptr_t address, void *dest, uint64_t size);
@@ -39,13 +66,85 @@ namespace ProcUtil
     pid_t GetParent(pid_t pid);
 
     uintptr_t FindPattern(pid_t pid, const std::string &query, const std::string &segment);
+    uintptr_t FindPattern(pid_t pid, const CompiledPattern &pattern, const std::string &segment);
 
     int QueryMemory(pid_t pid, uint8_t *query, const char *mask, uintptr_t *out, uint32_t amount);
+    int QueryMemory(pid_t pid, const CompiledPattern &pattern, uintptr_t *out, uint32_t amount, const std::string &area = "");
+
+    // Appends every match to `out`, only testing addresses that are a multiple of `alignment`
+    size_t QueryMemory(pid_t pid, const uint8_t *query, const char *mask, std::vector<uintptr_t> &out, uint32_t alignment = 1);
+    size_t QueryMemory(pid_t pid, const CompiledPattern &pattern, std::vector<uintptr_t> &out, uint32_t alignment = 1, const std::string &area = "");
+
+    // Hands hits to fn in batches as chunks are scanned, so memory use follows the hits found
+    // instead of a result limit picked up front. Returns the amount of hits delivered.
+    size_t StreamQuery(pid_t pid, const CompiledPattern &pattern, const ResultCallback &fn, uint32_t alignment = 1, const std::string &area = "");
+
+    // Appends the address of every naturally aligned value in [min, max], amount = 0 means no limit
+    size_t QueryIntRange(pid_t pid, int32_t min, int32_t max, std::vector<uintptr_t> &out, size_t amount = 0, const std::string &area = "");
+    size_t QueryDoubleRange(pid_t pid, double min, double max, std::vector<uintptr_t> &out, size_t amount = 0, const std::string &area = "");
+
+    // Reads `size` bytes from each of `addresses` into consecutive slots of `out` using as few
+    // process_vm_readv calls as possible, valid[i] is cleared for addresses that could not be read
+    size_t ReadMemoryBatch(pid_t pid, const uintptr_t *addresses, size_t count, size_t size, uint8_t *out, bool *valid);
 
     std::vector<MemPage> GetPages(pid_t pid, const std::string &name = "");
 
+    // Whether any mapping's name contains `name`, without building the page list
+    bool IsMapped(pid_t pid, const std::string &name);
+
+    // Regions worth reading when scanning
+    inline bool IsScannable(const MemPage &page)
+    {
+        return page.read == 'r' && page.name.compare(0, 6, "[vvar]") != 0 && page.name.compare(0, 10, "[vsyscall]") != 0;
+    }
+
+    std::vector<MemPage> GetScannablePages(pid_t pid, const std::string &area = "");
+
+    // Reads `regions` through a fixed size buffer, consecutive chunks of a region overlap by at least
+    // `overlap` bytes so anything up to overlap + 1 bytes long is whole in one of them.
+    // Returns false if fn returned false or the process is gone.
+    bool ReadChunks(pid_t pid, const std::vector<MemPage> &regions, size_t overlap, const ChunkCallback &fn);
+
+    struct ProcessStats
+    {
+        uint64_t cpu_ms;            // user + system time
+        uint64_t rss;               // kB
+        uint64_t minflt, majflt;
+        uint64_t voluntary_ctxt, nonvoluntary_ctxt; // of the main thread
+    };
+
+    // RSS in kB
     uint64_t GetMemoryUsage(pid_t pid);
 
+    bool GetProcessStats(pid_t pid, ProcessStats &out);
+
+    enum MappingClass
+    {
+        MAPPING_FLASH_CODE,     // executable mappings of libpepflashplayer
+        MAPPING_JIT,            // anonymous executable pages
+        MAPPING_HEAP,           // anonymous data and [heap]
+        MAPPING_FILES,          // any other file, including the flash plugin's data
+        MAPPING_OTHER,          // stacks, vdso, shared memory...
+        MAPPING_CLASS_COUNT
+    };
+
+    struct MemoryUsage
+    {
+        uint64_t rss, pss, anonymous, swap;     // kB
+    };
+
+    struct MemoryBreakdown
+    {
+        MemoryUsage total;
+        MemoryUsage classes[MAPPING_CLASS_COUNT];
+    };
+
+    // Whole process totals from /proc/<pid>/smaps_rollup, a lot less text than smaps
+    bool GetMemoryRollup(pid_t pid, MemoryUsage &out);
+
+    // Totals split by mapping class, parses every mapping in /proc/<pid>/smaps
+    bool GetMemoryBreakdown(pid_t pid, MemoryBreakdown &out);
+
     class Process
     {
     public:
@@ -0,0 +1,158 @@
+#include "process_monitor.h"
+
+#include <cerrno>
+#include <cstdint>
+
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/syscall.h>
+
+#include "proc_util.h"
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+static int pidfd_open(pid_t pid)
+{
+    return syscall(SYS_pidfd_open, pid, 0);
+}
+
+ProcessMonitor::ProcessMonitor() :
+    m_wake_fd(eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK)),
+    m_thread(&ProcessMonitor::runner, this)
+{
+}
+
+ProcessMonitor::~ProcessMonitor()
+{
+    m_running = false;
+    wake();
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+
+    for (auto &slot : m_slots)
+    {
+        if (slot.fd >= 0) close(slot.fd);
+    }
+    for (int fd : m_retired_fds)
+    {
+        close(fd);
+    }
+    if (m_wake_fd >= 0) close(m_wake_fd);
+}
+
+void ProcessMonitor::Watch(Slot slot, pid_t pid)
+{
+    {
+        std::scoped_lock lk { m_mut };
+        Watched &w = m_slots[slot];
+
+        // The runner may still be polling the old fd. Closing it here would let pidfd_open
+        // hand out the same number while it's in the poll set, so the runner closes it once
+        // it rebuilt the set, and drops events from older generations meanwhile.
+        if (w.fd >= 0)
+        {
+            m_retired_fds.push_back(w.fd);
+            w.fd = -1;
+        }
+        w.generation++;
+        w.pid = pid;
+        w.fallback = false;
+        w.alive = pid > 0;
+
+        if (pid > 0)
+        {
+            w.fd = pidfd_open(pid);
+            if (w.fd < 0)
+            {
+                // ESRCH means it's already gone, anything else means no pidfd support
+                w.alive = errno != ESRCH;
+                w.fallback = errno != ESRCH;
+            }
+        }
+    }
+    wake();
+}
+
+bool ProcessMonitor::Alive(Slot slot) const
+{
+    const Watched &w = m_slots[slot];
+    if (w.fallback)
+    {
+        return ProcUtil::ProcessExists(w.pid);
+    }
+    return w.alive;
+}
+
+void ProcessMonitor::wake()
+{
+    uint64_t one = 1;
+    if (m_wake_fd >= 0 && write(m_wake_fd, &one, sizeof(one)) < 0)
+    {
+        // Counter overflow, the runner is awake anyway
+    }
+}
+
+void ProcessMonitor::runner()
+{
+    pollfd fds[SLOT_COUNT + 1];
+    uint64_t generations[SLOT_COUNT];
+    int slots[SLOT_COUNT];
+
+    while (m_running)
+    {
+        nfds_t count = 0;
+        fds[count++] = { m_wake_fd, POLLIN, 0 };
+        {
+            std::scoped_lock lk { m_mut };
+
+            // Not in any poll set anymore
+            for (int fd : m_retired_fds)
+            {
+                close(fd);
+            }
+            m_retired_fds.clear();
+
+            for (int i = 0; i < SLOT_COUNT; i++)
+            {
+                if (m_slots[i].fd >= 0 && m_slots[i].alive)
+                {
+                    slots[count - 1] = i;
+                    generations[count - 1] = m_slots[i].generation;
+                    fds[count++] = { m_slots[i].fd, POLLIN, 0 };
+                }
+            }
+        }
+
+        if (poll(fds, count, -1) < 0 && errno != EINTR)
+        {
+            break;
+        }
+
+        if (fds[0].revents & POLLIN)
+        {
+            uint64_t value;
+            if (read(m_wake_fd, &value, sizeof(value)) < 0)
+            {
+                // Nothing pending
+            }
+        }
+
+        // A pidfd becomes readable when its process exits
+        std::scoped_lock lk { m_mut };
+        for (nfds_t i = 1; i < count; i++)
+        {
+            Watched &w = m_slots[slots[i - 1]];
+            if ((fds[i].revents & POLLIN) && w.generation == generations[i - 1])
+            {
+                w.alive = false;
+                close(w.fd);
+                w.fd = -1;
+            }
+        }
+    }
+}
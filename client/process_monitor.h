@@ -0,0 +1,61 @@
+#ifndef PROCESS_MONITOR_H
+#define PROCESS_MONITOR_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <sys/types.h>
+
+// Holds a pidfd for each watched process and polls them on its own thread, so checking
+// whether a process is still there is a flag read instead of a trip through /proc.
+// Kernels older than 5.3 have no pidfd_open, Alive() falls back to /proc there.
+class ProcessMonitor
+{
+public:
+    enum Slot
+    {
+        BROWSER,
+        FLASH,
+        SLOT_COUNT
+    };
+
+    ProcessMonitor();
+    ~ProcessMonitor();
+
+    ProcessMonitor(const ProcessMonitor &) = delete;
+    ProcessMonitor &operator=(const ProcessMonitor &) = delete;
+
+    // Replaces whatever the slot was watching, pid <= 0 stops watching
+    void Watch(Slot slot, pid_t pid);
+
+    // False once the watched process exited, or if nothing is watched in that slot
+    bool Alive(Slot slot) const;
+
+    inline pid_t Pid(Slot slot) const { return m_slots[slot].pid; }
+
+private:
+    struct Watched
+    {
+        std::atomic<pid_t> pid { -1 };
+        std::atomic<bool> alive { false };
+        std::atomic<bool> fallback { false };
+        int fd = -1;
+        // Bumped on every Watch so an exit seen on a replaced pidfd is ignored
+        uint64_t generation = 0;
+    };
+
+    void runner();
+    void wake();
+
+    mutable std::mutex m_mut;
+    Watched m_slots[SLOT_COUNT];
+    std::vector<int> m_retired_fds;     // replaced pidfds, closed by the runner before its next poll
+
+    int m_wake_fd = -1;
+    std::atomic<bool> m_running { true };
+    std::thread m_thread;
+};
+
+#endif /* PROCESS_MONITOR_H */
@@ -0,0 +1,112 @@
+#include "region_table.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include <signal.h>
+
+#include "maps_parser.h"
+
+// Every probed process gets a table, e.g. each browser child find_flash_process checks,
+// dead ones are dropped when a new pid is added and the least recently used past this
+#define MAX_CACHED_TABLES 32
+
+struct CachedTable
+{
+    size_t length;
+    size_t hash;
+    uint64_t last_used;
+    std::shared_ptr<const ProcUtil::RegionTable> table;
+};
+
+static std::mutex tables_mut;
+static std::unordered_map<pid_t, CachedTable> tables;
+static uint64_t tables_clock = 0;
+static std::atomic<uint64_t> reparse_count { 0 };
+
+// Called with tables_mut held, before `pid` is added
+static void evict_tables(pid_t pid)
+{
+    for (auto it = tables.begin(); it != tables.end(); )
+    {
+        if (it->first != pid && kill(it->first, 0) == -1 && errno == ESRCH)
+        {
+            it = tables.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+
+    while (tables.size() >= MAX_CACHED_TABLES)
+    {
+        auto oldest = std::min_element(tables.begin(), tables.end(), [] (auto &a, auto &b)
+        {
+            return a.second.last_used < b.second.last_used;
+        });
+        tables.erase(oldest);
+    }
+}
+
+std::shared_ptr<const ProcUtil::RegionTable> ProcUtil::RegionTable::Get(pid_t pid)
+{
+    // The file is read on every call anyway, keep the buffer around
+    thread_local MapsParser parser;
+
+    if (!parser.Read(pid))
+    {
+        Forget(pid);
+        return nullptr;
+    }
+
+    size_t length = parser.Raw().size();
+    size_t hash = std::hash<std::string_view>()(parser.Raw());
+
+    {
+        std::scoped_lock lk { tables_mut };
+        auto it = tables.find(pid);
+        if (it != tables.end() && it->second.length == length && it->second.hash == hash)
+        {
+            it->second.last_used = ++tables_clock;
+            return it->second.table;
+        }
+    }
+
+    parser.Parse();
+    reparse_count++;
+
+    auto table = std::make_shared<RegionTable>();
+    table->m_pages.reserve(parser.Regions().size());
+    for (auto &region : parser.Regions())
+    {
+        table->m_pages.emplace_back(region.start, region.end,
+                region.read, region.write, region.exec, region.cow,
+                region.offset, region.end - region.start, std::string(region.name));
+    }
+
+    std::scoped_lock lk { tables_mut };
+    if (!tables.count(pid))
+    {
+        evict_tables(pid);
+    }
+    tables[pid] = { length, hash, ++tables_clock, table };
+    return table;
+}
+
+uint64_t ProcUtil::RegionTable::ReparseCount()
+{
+    return reparse_count;
+}
+
+void ProcUtil::RegionTable::Forget(pid_t pid)
+{
+    std::scoped_lock lk { tables_mut };
+    tables.erase(pid);
+}
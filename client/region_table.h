@@ -0,0 +1,37 @@
+#ifndef REGION_TABLE_H
+#define REGION_TABLE_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "proc_util.h"
+
+namespace ProcUtil
+{
+    // Parsed maps of a process shared by the scans, the pointer index and flash discovery.
+    // Getting it re-reads the maps file, but only parses it again and builds a new table
+    // when the length or hash of the file changed since the last time.
+    class RegionTable
+    {
+    public:
+        // Current table of pid or nullptr if its maps can't be read. The table is immutable,
+        // holders keep a consistent view even if the process maps something new meanwhile.
+        static std::shared_ptr<const RegionTable> Get(pid_t pid);
+
+        // How many times a maps file was actually parsed, across every pid
+        static uint64_t ReparseCount();
+
+        // Drops the cached table of a process, e.g. once it exited
+        static void Forget(pid_t pid);
+
+        inline const std::vector<MemPage> &Pages() const { return m_pages; }
+
+    private:
+        std::vector<MemPage> m_pages;
+    };
+};
+
+#endif /* REGION_TABLE_H */
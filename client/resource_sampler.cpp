@@ -0,0 +1,186 @@
+#include "resource_sampler.h"
+
+#include <chrono>
+#include <climits>
+
+// Whether a memory figure moved by more than about 3% since the last full parse
+static bool moved(uint64_t now, uint64_t then)
+{
+    uint64_t delta = now > then ? now - then : then - now;
+    return delta > then / 32;
+}
+
+ResourceSampler::ResourceSampler(const ProcessMonitor &monitor, uint32_t interval_ms, uint32_t memory_interval_ms) :
+    m_monitor(monitor),
+    m_interval_ms(interval_ms),
+    m_memory_interval_ms(memory_interval_ms),
+    m_thread(&ResourceSampler::runner, this)
+{
+}
+
+ResourceSampler::~ResourceSampler()
+{
+    {
+        std::scoped_lock lk { m_mut };
+        m_running = false;
+    }
+    m_cv.notify_all();
+
+    if (m_thread.joinable())
+    {
+        m_thread.join();
+    }
+}
+
+void ResourceSampler::SetInterval(uint32_t interval_ms)
+{
+    {
+        std::scoped_lock lk { m_mut };
+        m_interval_ms = interval_ms;
+    }
+    m_cv.notify_all();
+}
+
+void ResourceSampler::SetMemoryInterval(uint32_t interval_ms)
+{
+    {
+        std::scoped_lock lk { m_mut };
+        m_memory_interval_ms = interval_ms;
+    }
+    m_cv.notify_all();
+}
+
+std::vector<ResourceSampler::Sample> ResourceSampler::History() const
+{
+    std::scoped_lock lk { m_mut };
+    return m_samples.Items();
+}
+
+std::vector<ResourceSampler::MemorySample> ResourceSampler::MemoryHistory() const
+{
+    std::scoped_lock lk { m_mut };
+    return m_memory_samples.Items();
+}
+
+bool ResourceSampler::sample_memory(int64_t now, MemorySample &sample)
+{
+    pid_t pid = m_monitor.Pid(ProcessMonitor::FLASH);
+    if (pid <= 0 || !m_monitor.Alive(ProcessMonitor::FLASH))
+    {
+        return false;
+    }
+
+    ProcUtil::MemoryUsage total;
+    if (!ProcUtil::GetMemoryRollup(pid, total))
+    {
+        return false;
+    }
+
+    // smaps is a few lines per mapping and flash has thousands of them, only split the
+    // totals again once they moved or every so often to catch shifts between classes
+    bool full = pid != m_breakdown_pid || m_since_breakdown >= MEMORY_BREAKDOWN_EVERY ||
+        moved(total.rss, m_breakdown.total.rss) || moved(total.anonymous, m_breakdown.total.anonymous) ||
+        moved(total.swap, m_breakdown.total.swap);
+
+    if (full)
+    {
+        if (!ProcUtil::GetMemoryBreakdown(pid, m_breakdown))
+        {
+            m_breakdown_pid = -1;
+            return false;
+        }
+        m_breakdown_pid = pid;
+        m_since_breakdown = 0;
+    }
+    else
+    {
+        m_since_breakdown++;
+    }
+
+    sample.timestamp_ms = now;
+    sample.pid = pid;
+    sample.detailed = full;
+    sample.memory = m_breakdown;
+    if (!full)
+    {
+        sample.memory.total = total;
+    }
+    return true;
+}
+
+void ResourceSampler::runner()
+{
+    std::unique_lock lk { m_mut };
+    int64_t next_memory_ms = 0;
+
+    while (m_running)
+    {
+        uint32_t interval_ms = m_interval_ms;
+        uint32_t memory_interval_ms = m_memory_interval_ms;
+
+        if (!interval_ms && !memory_interval_ms)
+        {
+            m_cv.wait(lk, [this] { return !m_running || m_interval_ms || m_memory_interval_ms; });
+            continue;
+        }
+
+        lk.unlock();
+
+        Sample samples[ProcessMonitor::SLOT_COUNT];
+        size_t count = 0;
+
+        int64_t now = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()).count();
+
+        for (int i = 0; interval_ms && i < ProcessMonitor::SLOT_COUNT; i++)
+        {
+            auto slot = static_cast<ProcessMonitor::Slot>(i);
+            pid_t pid = m_monitor.Pid(slot);
+
+            Sample &sample = samples[count];
+            if (pid > 0 && m_monitor.Alive(slot) && ProcUtil::GetProcessStats(pid, sample.stats))
+            {
+                sample.timestamp_ms = now;
+                sample.slot = slot;
+                sample.pid = pid;
+                count++;
+            }
+        }
+
+        MemorySample memory;
+        bool have_memory = false;
+        if (memory_interval_ms && now >= next_memory_ms)
+        {
+            have_memory = sample_memory(now, memory);
+            next_memory_ms = now + memory_interval_ms;
+        }
+
+        lk.lock();
+
+        for (size_t i = 0; i < count; i++)
+        {
+            m_samples.Push(samples[i]);
+        }
+        if (have_memory)
+        {
+            m_memory_samples.Push(memory);
+        }
+
+        // Sleep until whichever kind of sample is due next
+        int64_t wait_ms = interval_ms ? interval_ms : INT64_MAX;
+        if (memory_interval_ms)
+        {
+            wait_ms = std::min(wait_ms, std::max<int64_t>(next_memory_ms - now, 1));
+        }
+
+        m_cv.wait_for(lk, std::chrono::milliseconds(wait_ms), [&]
+        {
+            return !m_running || m_interval_ms != interval_ms || m_memory_interval_ms != memory_interval_ms;
+        });
+
+        if (m_memory_interval_ms != memory_interval_ms)
+        {
+            next_memory_ms = 0;
+        }
+    }
+}
@@ -0,0 +1,110 @@
+#ifndef RESOURCE_SAMPLER_H
+#define RESOURCE_SAMPLER_H
+
+#include <algorithm>
+#include <array>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "proc_util.h"
+#include "process_monitor.h"
+
+// Samples the browser and flash processes the monitor is watching on its own thread and
+// keeps the latest SAMPLER_HISTORY samples, oldest get overwritten. Flash's memory is also
+// split by mapping class at a slower rate into a history of its own.
+class ResourceSampler
+{
+public:
+    static constexpr size_t SAMPLER_HISTORY = 1024;
+    static constexpr size_t MEMORY_HISTORY = 1024;
+
+    // Memory samples between full smaps parses while the rollup barely moves
+    static constexpr uint32_t MEMORY_BREAKDOWN_EVERY = 30;
+
+    struct Sample
+    {
+        int64_t timestamp_ms;   // unix time
+        ProcessMonitor::Slot slot;
+        pid_t pid;
+        ProcUtil::ProcessStats stats;
+    };
+
+    struct MemorySample
+    {
+        int64_t timestamp_ms;   // unix time
+        pid_t pid;
+        bool detailed;          // false if only the totals are new and the classes are from an earlier sample
+        ProcUtil::MemoryBreakdown memory;
+    };
+
+    ResourceSampler(const ProcessMonitor &monitor, uint32_t interval_ms = 1000, uint32_t memory_interval_ms = 10000);
+    ~ResourceSampler();
+
+    ResourceSampler(const ResourceSampler &) = delete;
+    ResourceSampler &operator=(const ResourceSampler &) = delete;
+
+    // 0 pauses sampling
+    void SetInterval(uint32_t interval_ms);
+
+    // 0 pauses memory sampling
+    void SetMemoryInterval(uint32_t interval_ms);
+
+    // Samples in the buffer, oldest first
+    std::vector<Sample> History() const;
+    std::vector<MemorySample> MemoryHistory() const;
+
+private:
+    template <typename T, size_t N>
+    struct Ring
+    {
+        std::array<T, N> items;
+        size_t next = 0;
+        size_t count = 0;
+
+        void Push(const T &item)
+        {
+            items[next] = item;
+            next = (next + 1) % N;
+            count = std::min(count + 1, N);
+        }
+
+        std::vector<T> Items() const
+        {
+            std::vector<T> r;
+            r.reserve(count);
+
+            size_t first = (next + N - count) % N;
+            for (size_t i = 0; i < count; i++)
+            {
+                r.push_back(items[(first + i) % N]);
+            }
+            return r;
+        }
+    };
+
+    void runner();
+    bool sample_memory(int64_t now, MemorySample &sample);
+
+    const ProcessMonitor &m_monitor;
+
+    mutable std::mutex m_mut;
+    std::condition_variable m_cv;
+    uint32_t m_interval_ms;
+    uint32_t m_memory_interval_ms;
+    bool m_running = true;
+
+    Ring<Sample, SAMPLER_HISTORY> m_samples;
+    Ring<MemorySample, MEMORY_HISTORY> m_memory_samples;
+
+    // Last full smaps parse, only touched by the sampling thread
+    ProcUtil::MemoryBreakdown m_breakdown;
+    pid_t m_breakdown_pid = -1;
+    uint32_t m_since_breakdown = 0;
+
+    std::thread m_thread;
+};
+
+#endif /* RESOURCE_SAMPLER_H */
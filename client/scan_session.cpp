@@ -0,0 +1,116 @@
+#include "scan_session.h"
+
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "proc_util.h"
+
+size_t ScanSession::Start(pid_t pid, uint64_t value)
+{
+    size_t value_size = ValueSize();
+    std::string mask(value_size, 'x');
+
+    // Refine reads exactly value_size bytes back, keep the stored value comparable
+    if (value_size < sizeof(value))
+    {
+        value &= (1ULL << (value_size * 8)) - 1;
+    }
+
+    m_addresses.clear();
+    m_values.clear();
+
+    ProcUtil::QueryMemory(pid, reinterpret_cast<const uint8_t *>(&value), mask.c_str(), m_addresses, value_size);
+
+    m_addresses.shrink_to_fit();
+    m_values.assign(m_addresses.size(), value);
+
+    return m_addresses.size();
+}
+
+size_t ScanSession::Refine(pid_t pid, ScanPredicate predicate, uint64_t a, uint64_t b)
+{
+    size_t count = m_addresses.size();
+    size_t value_size = ValueSize();
+
+    if (!count)
+    {
+        return 0;
+    }
+
+    std::vector<uint8_t> buf(count * value_size);
+    std::unique_ptr<bool[]> valid(new bool[count]);
+
+    ProcUtil::ReadMemoryBatch(pid, m_addresses.data(), count, value_size, buf.data(), valid.get());
+
+    // Compact in place, keeps the arrays sorted
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!valid[i])
+        {
+            continue;
+        }
+
+        uint64_t value = 0;
+        std::memcpy(&value, &buf[i * value_size], value_size);
+
+        if (matches(predicate, m_values[i], value, a, b))
+        {
+            m_addresses[kept] = m_addresses[i];
+            m_values[kept] = value;
+            kept++;
+        }
+    }
+
+    m_addresses.resize(kept);
+    m_values.resize(kept);
+
+    return kept;
+}
+
+int ScanSession::compare(uint64_t lhs, uint64_t rhs) const
+{
+    switch (m_type)
+    {
+        case ScanValueType::INT:
+        {
+            int32_t l = static_cast<int32_t>(lhs), r = static_cast<int32_t>(rhs);
+            return (l > r) - (l < r);
+        }
+        case ScanValueType::LONG:
+        {
+            int64_t l = static_cast<int64_t>(lhs), r = static_cast<int64_t>(rhs);
+            return (l > r) - (l < r);
+        }
+        case ScanValueType::DOUBLE:
+        {
+            double l, r;
+            std::memcpy(&l, &lhs, sizeof(l));
+            std::memcpy(&r, &rhs, sizeof(r));
+            return (l > r) - (l < r);
+        }
+    }
+    return 0;
+}
+
+bool ScanSession::matches(ScanPredicate predicate, uint64_t previous, uint64_t value, uint64_t a, uint64_t b) const
+{
+    switch (predicate)
+    {
+        case ScanPredicate::EQUALS:
+            return compare(value, a) == 0;
+        case ScanPredicate::CHANGED:
+            return value != previous;
+        case ScanPredicate::UNCHANGED:
+            return value == previous;
+        case ScanPredicate::INCREASED:
+            return compare(value, previous) > 0;
+        case ScanPredicate::DECREASED:
+            return compare(value, previous) < 0;
+        case ScanPredicate::IN_RANGE:
+            return compare(value, a) >= 0 && compare(value, b) <= 0;
+        default:
+            return false;
+    }
+}
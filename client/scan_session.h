@@ -0,0 +1,62 @@
+#ifndef SCAN_SESSION_H
+#define SCAN_SESSION_H
+
+#include <cstdint>
+#include <vector>
+
+#include <sys/types.h>
+
+enum class ScanValueType
+{
+    INT,
+    LONG,
+    DOUBLE
+};
+
+enum class ScanPredicate
+{
+    EQUALS,     // value == a
+    CHANGED,    // value != previous value
+    UNCHANGED,  // value == previous value
+    INCREASED,  // value > previous value
+    DECREASED,  // value < previous value
+    IN_RANGE,   // a <= value <= b
+
+    NONE
+};
+
+// Candidate addresses of a value we are narrowing down over several rounds.
+// Values are passed around as raw 64 bit patterns and interpreted according to the session type,
+// so for DOUBLE sessions `a` and `b` are the bits of a double.
+class ScanSession
+{
+public:
+    ScanSession(ScanValueType type) : m_type(type) { }
+
+    // Full memory scan, replaces the current candidates
+    size_t Start(pid_t pid, uint64_t value);
+
+    // Re-reads only the current candidates and keeps the ones matching the predicate
+    size_t Refine(pid_t pid, ScanPredicate predicate, uint64_t a = 0, uint64_t b = 0);
+
+    inline ScanValueType Type() const { return m_type; }
+    inline size_t Size() const { return m_addresses.size(); }
+    inline const std::vector<uintptr_t> &Addresses() const { return m_addresses; }
+
+    inline size_t ValueSize() const
+    {
+        return m_type == ScanValueType::INT ? sizeof(int32_t) : sizeof(int64_t);
+    }
+
+private:
+    int compare(uint64_t lhs, uint64_t rhs) const;
+    bool matches(ScanPredicate predicate, uint64_t previous, uint64_t value, uint64_t a, uint64_t b) const;
+
+    ScanValueType m_type;
+
+    // Sorted, m_values[i] is the last value read from m_addresses[i]
+    std::vector<uintptr_t> m_addresses;
+    std::vector<uint64_t> m_values;
+};
+
+#endif /* SCAN_SESSION_H */
@@ -0,0 +1,202 @@
+#ifndef COMPILED_PATTERN_H
+#define COMPILED_PATTERN_H
+
+#include <array>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// A byte pattern with wildcards, parsed once and reused for every scan.
+// The longest run of non-wildcard bytes is used as anchor and searched with
+// Boyer-Moore-Horspool, the rest of the pattern is only checked around anchor hits.
+class CompiledPattern
+{
+public:
+    static constexpr size_t npos = static_cast<size_t>(-1);
+
+    CompiledPattern() = default;
+
+    // IDA style, "48 8B ?? ?? 05", any token containing a '?' is a wildcard
+    explicit CompiledPattern(const std::string &ida)
+    {
+        const char *s = ida.c_str();
+        while (*s)
+        {
+            if (*s == ' ')
+            {
+                s++;
+                continue;
+            }
+
+            const char *token = s;
+            while (*s && *s != ' ')
+            {
+                s++;
+            }
+
+            if (std::memchr(token, '?', s - token))
+            {
+                m_bytes.push_back(0);
+                m_mask.push_back(false);
+                continue;
+            }
+
+            char *end = nullptr;
+            unsigned long value = std::strtoul(token, &end, 16);
+            if (end != s || value > 0xff)
+            {
+                m_bytes.clear();
+                m_mask.clear();
+                return;
+            }
+            m_bytes.push_back(static_cast<uint8_t>(value));
+            m_mask.push_back(true);
+        }
+        compile();
+    }
+
+    // Same format as ProcUtil::QueryMemory, mask[i] == '?' is a wildcard
+    CompiledPattern(const uint8_t *bytes, const char *mask, size_t size) :
+        m_bytes(bytes, bytes + size),
+        m_mask(size)
+    {
+        for (size_t i = 0; i < size; i++)
+        {
+            m_mask[i] = mask[i] != '?';
+        }
+        compile();
+    }
+
+    inline bool Valid() const { return !m_bytes.empty(); }
+    inline size_t Size() const { return m_bytes.size(); }
+    inline const uint8_t *Data() const { return m_bytes.data(); }
+
+    inline bool Matches(const uint8_t *data) const
+    {
+        for (size_t i = 0; i < m_bytes.size(); i++)
+        {
+            if (m_mask[i] && data[i] != m_bytes[i])
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // Offset of the first match at or after `from`, or npos
+    size_t Find(const uint8_t *data, size_t size, size_t from = 0) const
+    {
+        size_t pattern_size = m_bytes.size();
+        if (!pattern_size || size < pattern_size || from > size - pattern_size)
+        {
+            return npos;
+        }
+
+        size_t last = size - pattern_size;
+
+        if (!m_anchor_size)
+        {
+            return from;
+        }
+
+        const uint8_t *anchor = &m_bytes[m_anchor_offset];
+        // Window over the anchor position, i.e. match start + anchor offset
+        size_t pos = from + m_anchor_offset;
+        size_t end = last + m_anchor_offset;
+
+        if (m_anchor_size == 1)
+        {
+            while (pos <= end)
+            {
+                auto *hit = static_cast<const uint8_t *>(std::memchr(data + pos, anchor[0], end - pos + 1));
+                if (!hit)
+                {
+                    return npos;
+                }
+                pos = hit - data;
+                if (Matches(data + pos - m_anchor_offset))
+                {
+                    return pos - m_anchor_offset;
+                }
+                pos++;
+            }
+            return npos;
+        }
+
+        uint8_t tail = anchor[m_anchor_size - 1];
+        while (pos <= end)
+        {
+            uint8_t c = data[pos + m_anchor_size - 1];
+            if (c == tail
+                && std::memcmp(data + pos, anchor, m_anchor_size - 1) == 0
+                && Matches(data + pos - m_anchor_offset))
+            {
+                return pos - m_anchor_offset;
+            }
+            pos += m_skip[c];
+        }
+        return npos;
+    }
+
+    // Calls on_match(offset) for every match whose offset is a multiple of alignment,
+    // stops early if on_match returns false
+    template <typename F>
+    bool FindAll(const uint8_t *data, size_t size, size_t alignment, F on_match) const
+    {
+        for (size_t pos = Find(data, size); pos != npos; pos = Find(data, size, pos + 1))
+        {
+            if (alignment > 1 && pos % alignment)
+            {
+                continue;
+            }
+            if (!on_match(pos))
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+
+private:
+    void compile()
+    {
+        // Longest run of fixed bytes
+        m_anchor_offset = 0;
+        m_anchor_size = 0;
+        for (size_t i = 0; i < m_mask.size(); )
+        {
+            if (!m_mask[i])
+            {
+                i++;
+                continue;
+            }
+            size_t start = i;
+            while (i < m_mask.size() && m_mask[i])
+            {
+                i++;
+            }
+            if (i - start > m_anchor_size)
+            {
+                m_anchor_offset = start;
+                m_anchor_size = i - start;
+            }
+        }
+
+        m_skip.fill(m_anchor_size ? m_anchor_size : 1);
+        for (size_t i = 0; i + 1 < m_anchor_size; i++)
+        {
+            m_skip[m_bytes[m_anchor_offset + i]] = m_anchor_size - 1 - i;
+        }
+    }
+
+    std::vector<uint8_t> m_bytes;
+    std::vector<uint8_t> m_mask;
+
+    size_t m_anchor_offset = 0;
+    size_t m_anchor_size = 0;
+    std::array<size_t, 256> m_skip { };
+};
+
+#endif /* COMPILED_PATTERN_H */
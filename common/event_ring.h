@@ -0,0 +1,158 @@
+#ifndef EVENT_RING_H
+#define EVENT_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+
+#include "futex.h"
+
+// Events do_lib pushes to the client as they happen, next to the command ring in the shared
+// segment. One producer and one consumer: do_lib serializes its hooks and the client its readers.
+// A full ring drops new events and counts them, the game thread never waits on the client.
+// Nothing is pushed for types the client didn't ask for, so an unread ring costs a load per event.
+// The producer closes it along with the command ring, nothing is pushed to it after that.
+
+#define EVENT_RING_SIZE 4096    // power of two
+
+enum EventType : uint32_t
+{
+    EVENT_INSTALL,              // value = main application object
+    EVENT_UNINSTALL,
+    EVENT_HOOK,                 // id = method id, value = this object
+    EVENT_ENTITY_ADDED,         // id = ship id, value = ship object
+    EVENT_ENTITY_REMOVED,       // id = ship id, value = ship object
+    EVENT_CHUNK_FREED,          // value = chunk address
+
+    EVENT_TYPE_COUNT
+};
+
+// Rare enough to always keep, the install event is pushed before any client could ask for it
+#define EVENT_DEFAULT_MASK ((1u << EVENT_INSTALL) | (1u << EVENT_UNINSTALL))
+
+struct Event
+{
+    uint32_t type;
+    uint32_t id;
+    uint64_t time_ns;           // CLOCK_MONOTONIC
+    uint64_t value;
+};
+
+static_assert(sizeof(Event) == 24, "Event layout changed");
+static_assert((EVENT_RING_SIZE & (EVENT_RING_SIZE - 1)) == 0, "EVENT_RING_SIZE has to be a power of two");
+
+class EventRing
+{
+public:
+    // Only the server calls this, before the command ring's magic is published
+    void Reset()
+    {
+        m_head = 0;
+        m_consumer_waiting = 0;
+        m_dropped = 0;
+        m_closed = 0;
+        m_tail = 0;
+        m_mask = EVENT_DEFAULT_MASK;
+    }
+
+    // Producer side
+
+    inline bool Wants(EventType type) const
+    {
+        return m_mask.load(std::memory_order_relaxed) & (1u << type);
+    }
+
+    bool Push(const Event &event)
+    {
+        uint32_t head = m_head.load(std::memory_order_relaxed);
+        if (head - m_tail.load(std::memory_order_acquire) >= EVENT_RING_SIZE)
+        {
+            m_dropped++;
+            return false;
+        }
+
+        m_events[head & (EVENT_RING_SIZE - 1)] = event;
+        m_head = head + 1;
+
+        if (m_consumer_waiting)
+        {
+            futex_wake(m_head, 1);
+        }
+        return true;
+    }
+
+    // Wakes the consumer, which stops waiting on this ring
+    void Close()
+    {
+        m_closed.store(1, std::memory_order_release);
+        futex_wake(m_head, INT_MAX);
+    }
+
+    // Consumer side
+
+    inline bool Closed() const { return m_closed.load(std::memory_order_acquire); }
+
+    // Bit (1 << type) for every type to be pushed
+    inline void SetMask(uint32_t mask) { m_mask = mask; }
+    inline uint32_t Mask() const { return m_mask; }
+
+    inline uint64_t Dropped() const { return m_dropped; }
+
+    // Waits until there's something to pop, false if the deadline passed first. Whatever was
+    // pushed before the ring was closed can still be popped, after that it returns false at once.
+    template <typename Deadline>
+    bool Wait(Deadline deadline)
+    {
+        while (true)
+        {
+            m_consumer_waiting++;
+            uint32_t head = m_head;
+            if (head != m_tail.load(std::memory_order_relaxed))
+            {
+                m_consumer_waiting--;
+                return true;
+            }
+            if (Closed())
+            {
+                m_consumer_waiting--;
+                return false;
+            }
+            bool ok = futex_wait(m_head, head, deadline);
+            m_consumer_waiting--;
+            if (!ok)
+            {
+                return m_head != m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Moves up to `max` events into `out`, returns how many
+    size_t Pop(Event *out, size_t max)
+    {
+        uint32_t tail = m_tail.load(std::memory_order_relaxed);
+        uint32_t count = std::min<size_t>(m_head.load(std::memory_order_acquire) - tail, max);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            out[i] = m_events[(tail + i) & (EVENT_RING_SIZE - 1)];
+        }
+        m_tail.store(tail + count, std::memory_order_release);
+        return count;
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> m_head;           // written by the producer, the consumer sleeps on it
+    std::atomic<uint32_t> m_consumer_waiting;
+    std::atomic<uint64_t> m_dropped;
+    std::atomic<uint32_t> m_closed;
+
+    alignas(64) std::atomic<uint32_t> m_tail;           // written by the consumer
+    std::atomic<uint32_t> m_mask;
+
+    alignas(64) Event m_events[EVENT_RING_SIZE];
+};
+
+#endif /* EVENT_RING_H */
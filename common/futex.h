@@ -0,0 +1,42 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Futex calls on words in shared memory, which is why these can't be private futexes
+
+// Sleeps while word == value, false once the deadline passed
+template <typename Deadline>
+inline bool futex_wait(std::atomic<uint32_t> &word, uint32_t value, Deadline deadline)
+{
+    auto left = deadline - Deadline::clock::now();
+    if (left <= Deadline::duration::zero())
+    {
+        return false;
+    }
+
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(left).count();
+    timespec timeout { .tv_sec = static_cast<time_t>(ns / 1000000000), .tv_nsec = static_cast<long>(ns % 1000000000) };
+
+    if (syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAIT, value, &timeout, nullptr, 0) == -1 &&
+            errno == ETIMEDOUT)
+    {
+        return false;
+    }
+    return true;
+}
+
+inline void futex_wake(std::atomic<uint32_t> &word, int count)
+{
+    syscall(SYS_futex, reinterpret_cast<uint32_t *>(&word), FUTEX_WAKE, count, nullptr, nullptr, 0);
+}
+
+#endif /* FUTEX_H */
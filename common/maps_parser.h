@@ -0,0 +1,188 @@
+#ifndef MAPS_PARSER_H
+#define MAPS_PARSER_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+// Parser for /proc/<pid>/maps. The file is read straight into a buffer kept between calls
+// and parsed in place, names are views into that buffer. Once the buffers have grown
+// to fit, loading again doesn't allocate.
+class MapsParser
+{
+public:
+    struct Region
+    {
+        uintptr_t start, end;
+        char read, write, exec, cow;
+        uint64_t offset;
+        uint64_t inode;
+        std::string_view name;  // empty for anonymous mappings, valid until the next Load
+    };
+
+    // pid <= 0 reads our own maps
+    bool Load(pid_t pid)
+    {
+        if (!Read(pid))
+            return false;
+        Parse();
+        return true;
+    }
+
+    bool LoadFile(const char *path)
+    {
+        if (!ReadFile(path))
+            return false;
+        Parse();
+        return true;
+    }
+
+    // Only reads the file, Regions() stays empty until Parse() is called
+    bool Read(pid_t pid)
+    {
+        char path[32];
+        if (pid > 0)
+            snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+        else
+            snprintf(path, sizeof(path), "/proc/self/maps");
+        return ReadFile(path);
+    }
+
+    bool ReadFile(const char *path)
+    {
+        m_regions.clear();
+        m_size = 0;
+
+        int fd = open(path, O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+        {
+            return false;
+        }
+
+        if (m_buf.empty())
+        {
+            m_buf.resize(64 * 1024);
+        }
+
+        // procfs hands out as many whole lines as fit, this is one read unless the buffer is too small
+        ssize_t n;
+        while ((n = read(fd, m_buf.data() + m_size, m_buf.size() - m_size)) > 0)
+        {
+            m_size += n;
+            if (m_size == m_buf.size())
+            {
+                m_buf.resize(m_buf.size() * 2);
+            }
+        }
+        close(fd);
+
+        if (n < 0)
+        {
+            m_size = 0;
+            return false;
+        }
+        return true;
+    }
+
+    inline const std::vector<Region> &Regions() const { return m_regions; }
+
+    // The file as it was read, e.g. to tell whether anything changed
+    inline std::string_view Raw() const { return std::string_view(m_buf.data(), m_size); }
+
+    void Parse()
+    {
+        m_regions.clear();
+
+        const char *p = m_buf.data();
+        const char *end = p + m_size;
+
+        while (p < end)
+        {
+            const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+            if (!eol)
+            {
+                eol = end;
+            }
+
+            Region region;
+            if (ParseLine(p, eol, region))
+            {
+                m_regions.push_back(region);
+            }
+            p = eol + 1;
+        }
+    }
+
+    // "start-end perms offset major:minor inode     name", also the header lines of smaps
+    static bool ParseLine(const char *p, const char *eol, Region &region)
+    {
+        region.start = parse_hex(p, eol);
+        p++;                                // '-'
+        region.end = parse_hex(p, eol);
+        p++;                                // ' '
+
+        if (eol - p < 5)
+        {
+            return false;
+        }
+        region.read = p[0];
+        region.write = p[1];
+        region.exec = p[2];
+        region.cow = p[3];
+        p += 5;
+
+        region.offset = parse_hex(p, eol);
+        p++;
+        parse_hex(p, eol);                  // major
+        p++;
+        parse_hex(p, eol);                  // minor
+        p++;
+        region.inode = parse_dec(p, eol);
+
+        while (p < eol && *p == ' ')
+        {
+            p++;
+        }
+        region.name = std::string_view(p, eol - p);
+        return true;
+    }
+
+private:
+    static uint64_t parse_hex(const char *&p, const char *end)
+    {
+        uint64_t value = 0;
+        for (; p < end; p++)
+        {
+            char c = *p;
+            if (c >= '0' && c <= '9')
+                value = (value << 4) | (c - '0');
+            else if (c >= 'a' && c <= 'f')
+                value = (value << 4) | (c - 'a' + 10);
+            else
+                break;
+        }
+        return value;
+    }
+
+    static uint64_t parse_dec(const char *&p, const char *end)
+    {
+        uint64_t value = 0;
+        for (; p < end && *p >= '0' && *p <= '9'; p++)
+        {
+            value = value * 10 + (*p - '0');
+        }
+        return value;
+    }
+
+    std::vector<char> m_buf;
+    size_t m_size = 0;
+    std::vector<Region> m_regions;
+};
+
+#endif /* MAPS_PARSER_H */
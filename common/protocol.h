@@ -0,0 +1,324 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+#include <vector>
+
+#include <sys/types.h>
+
+#include "event_ring.h"
+#include "shm_ring.h"
+#include "state_mirror.h"
+
+// Messages exchanged between the client and do_lib through the ring. Every message is a frame
+// in a slot's arena: a header carrying its type and total length, the fixed fields of that type,
+// then a variable length tail (call arguments, strings, scan results...). Only `size` bytes of a
+// frame are ever copied. do_lib writes the response over the request in the same arena.
+
+// Bump whenever a message changes meaning without changing size
+#define PROTOCOL_VERSION 6
+
+// Frames inside a batch start 8 byte aligned, so do the tails of pointers and entries
+#define FRAME_ALIGN 8
+
+#define MAX_FRAME_SIZE SHM_ARENA_SIZE
+
+#define MAX_BATCH_COMMANDS 64
+
+enum Capability : uint32_t
+{
+    CAP_SCAN = 1 << 0,
+    CAP_INSTANCES = 1 << 1,
+    CAP_CENSUS = 1 << 2,
+    CAP_BATCH = 1 << 3,
+    CAP_EVENTS = 1 << 4,
+    CAP_MIRROR = 1 << 5,
+};
+
+// The SysV segment do_lib creates, keyed by flash's pid. The ring comes first, its magic says
+// whether the rest is initialized.
+struct SharedSegment
+{
+    ShmRing ring;
+    EventRing events;
+    StateMirror mirror;
+};
+
+enum class MessageType : uint32_t
+{
+    CALL,
+    RESULT,
+    SEND_NOTIFICATION,
+    REFINE,
+    UPGRADE,
+    USE_ITEM,
+    KEY_CLICK,
+    MOUSE_CLICK,
+    CHECK_SIGNATURE,
+    SCAN,
+    INSTANCES,
+    CENSUS,
+    BATCH,
+
+    NONE
+};
+
+struct MessageHeader
+{
+    MessageType type;
+    uint32_t size;          // whole frame, header included
+    uint32_t error;         // set by do_lib when the command couldn't run
+    uint32_t reserved;
+};
+
+// Followed by argc arguments
+struct CallFunctionMessage
+{
+    MessageHeader header;
+    uintptr_t object;
+    uint32_t index;
+    uint32_t argc;
+};
+
+// What a CALL is answered with
+struct FunctionResultMessage
+{
+    MessageHeader header;
+    uintptr_t value;
+};
+
+// Followed by argc arguments, then the notification name
+struct SendNotificationMessage
+{
+    MessageHeader header;
+    uint32_t argc;
+    uint32_t name_length;
+};
+
+struct RefineMessage
+{
+    MessageHeader header;
+    uintptr_t refine_util;
+    uint32_t ore, amount;
+};
+
+// Followed by the item name
+struct UseItemMessage
+{
+    MessageHeader header;
+    uint8_t action_type;
+    uint8_t action_bar;
+    uint16_t name_length;
+
+    // ItemsControlMenuConstants.ACTION_SELECTION == 1
+    // ItemsControlMenuConstants.ACTION_TOOGLE == 0
+    // ItemsControlMenuConstants.ACTION_ONE_SHOT == 1
+    // barId = _loc2_.barId == CATEGORY_BAR ? 0 : 1;
+};
+
+struct KeyClickMessage
+{
+    MessageHeader header;
+    uint32_t key;
+};
+
+struct MouseClickMessage
+{
+    MessageHeader header;
+    uint32_t button;
+    int32_t x;
+    int32_t y;
+};
+
+// Followed by the signature
+struct CheckSignatureMessage
+{
+    MessageHeader header;
+    uintptr_t object;
+    uint32_t index;
+    uint32_t method_name;
+    uint32_t signature_length;
+
+    int32_t result;
+};
+
+// Followed by `size` query bytes and `size` mask characters, the response by `found` addresses
+struct ScanMessage
+{
+    MessageHeader header;
+    uint32_t size;
+    uint32_t alignment;
+    uint32_t max_results;
+    char area[64];
+
+    uint32_t found;
+};
+
+// Followed by the class name, the response by `found` addresses
+struct InstancesMessage
+{
+    MessageHeader header;
+    uint32_t max_results;
+    uint32_t name_length;
+
+    uint32_t found;
+    uint32_t padding;
+};
+
+struct CensusEntry
+{
+    uint64_t count;
+    char name[56];
+};
+
+// The response is followed by `found` entries, most common class first
+struct CensusMessage
+{
+    MessageHeader header;
+
+    uint32_t found;
+    uint32_t padding;
+};
+
+// Followed by `count` frames that run back to back in one pass of the game thread, so they land
+// in the same frame. Each gets its response written over it, never longer than the request.
+struct BatchMessage
+{
+    MessageHeader header;
+    uint32_t count;
+
+    uint32_t executed;
+};
+
+static_assert(sizeof(MessageHeader) == 16 && offsetof(MessageHeader, size) == 4, "MessageHeader layout changed");
+static_assert(sizeof(uintptr_t) == 8, "Both sides are 64 bit, the layouts below assume it");
+
+// Pointer and entry tails have to stay aligned
+static_assert(sizeof(CallFunctionMessage) == 32 && offsetof(CallFunctionMessage, argc) == 28, "CallFunctionMessage layout changed");
+static_assert(sizeof(FunctionResultMessage) == 24, "FunctionResultMessage layout changed");
+static_assert(sizeof(SendNotificationMessage) == 24, "SendNotificationMessage layout changed");
+static_assert(sizeof(RefineMessage) == 32, "RefineMessage layout changed");
+static_assert(sizeof(UseItemMessage) == 20, "UseItemMessage layout changed");
+static_assert(sizeof(KeyClickMessage) == 20, "KeyClickMessage layout changed");
+static_assert(sizeof(MouseClickMessage) == 28, "MouseClickMessage layout changed");
+static_assert(sizeof(CheckSignatureMessage) == 40 && offsetof(CheckSignatureMessage, result) == 36, "CheckSignatureMessage layout changed");
+static_assert(sizeof(ScanMessage) == 96 && offsetof(ScanMessage, found) == 92, "ScanMessage layout changed");
+static_assert(sizeof(InstancesMessage) == 32, "InstancesMessage layout changed");
+static_assert(sizeof(CensusEntry) == 64 && sizeof(CensusMessage) == 24, "CensusMessage layout changed");
+static_assert(sizeof(BatchMessage) == 24, "BatchMessage layout changed");
+
+// A CALL inside a batch is answered in place
+static_assert(sizeof(FunctionResultMessage) <= sizeof(CallFunctionMessage), "A RESULT has to fit over its CALL");
+
+static_assert(static_cast<uint32_t>(MessageType::NONE) <= SHM_MAX_MESSAGE_TYPES, "Too many message types for the handshake");
+
+// Bytes a frame takes up when followed by another one
+inline uint32_t frame_size(uint32_t size)
+{
+    return (size + FRAME_ALIGN - 1) & ~(FRAME_ALIGN - 1);
+}
+
+// Length of the fixed part of a message, 0 for types without one
+inline uint32_t message_size(MessageType type)
+{
+    switch (type)
+    {
+        case MessageType::CALL: return sizeof(CallFunctionMessage);
+        case MessageType::RESULT: return sizeof(FunctionResultMessage);
+        case MessageType::SEND_NOTIFICATION: return sizeof(SendNotificationMessage);
+        case MessageType::REFINE: return sizeof(RefineMessage);
+        case MessageType::USE_ITEM: return sizeof(UseItemMessage);
+        case MessageType::KEY_CLICK: return sizeof(KeyClickMessage);
+        case MessageType::MOUSE_CLICK: return sizeof(MouseClickMessage);
+        case MessageType::CHECK_SIGNATURE: return sizeof(CheckSignatureMessage);
+        case MessageType::SCAN: return sizeof(ScanMessage);
+        case MessageType::INSTANCES: return sizeof(InstancesMessage);
+        case MessageType::CENSUS: return sizeof(CensusMessage);
+        case MessageType::BATCH: return sizeof(BatchMessage);
+        default: return 0;
+    }
+}
+
+// Whether a frame read from the arena can be handled, `available` is what's left of the arena
+inline bool valid_frame(const MessageHeader *header, size_t available)
+{
+    if (available < sizeof(MessageHeader) || header->size > available || header->type >= MessageType::NONE)
+    {
+        return false;
+    }
+    uint32_t fixed = message_size(header->type);
+    return fixed && header->size >= fixed;
+}
+
+// The variable length part of a message, right after its fixed fields
+template <typename T, typename M>
+inline T *tail(M *message)
+{
+    return reinterpret_cast<T *>(message + 1);
+}
+
+template <typename M>
+inline size_t tail_size(const M *message)
+{
+    return message->header.size - sizeof(M);
+}
+
+// What do_lib announces in the ring, and what the client expects from it
+inline ShmRing::Handshake protocol_handshake(uint32_t capabilities = 0, pid_t server_pid = 0)
+{
+    ShmRing::Handshake handshake { };
+    handshake.version = PROTOCOL_VERSION;
+    handshake.capabilities = capabilities;
+    handshake.server_pid = server_pid;
+    handshake.message_types = static_cast<uint32_t>(MessageType::NONE);
+
+    for (uint32_t i = 0; i < handshake.message_types; i++)
+    {
+        handshake.message_sizes[i] = message_size(static_cast<MessageType>(i));
+    }
+    return handshake;
+}
+
+// A message being put together by the client. Pointers from As() don't survive an Append.
+class Frame
+{
+public:
+    explicit Frame(MessageType type) : m_data(std::max<size_t>(message_size(type), sizeof(MessageHeader)))
+    {
+        Header()->type = type;
+        Header()->size = m_data.size();
+    }
+
+    template <typename M>
+    inline M *As() { return reinterpret_cast<M *>(m_data.data()); }
+
+    inline MessageHeader *Header() { return As<MessageHeader>(); }
+
+    void Append(const void *data, size_t size)
+    {
+        auto *bytes = static_cast<const uint8_t *>(data);
+        m_data.insert(m_data.end(), bytes, bytes + size);
+        Header()->size = m_data.size();
+    }
+
+    inline void Append(std::string_view s) { Append(s.data(), s.size()); }
+
+    // Pads to where the next frame of a batch starts
+    void Align()
+    {
+        m_data.resize(frame_size(m_data.size()));
+        Header()->size = m_data.size();
+    }
+
+    inline const uint8_t *Data() const { return m_data.data(); }
+    inline size_t Size() const { return m_data.size(); }
+
+private:
+    std::vector<uint8_t> m_data;
+};
+
+#endif /* PROTOCOL_H */
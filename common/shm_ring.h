@@ -0,0 +1,427 @@
+#ifndef SHM_RING_H
+#define SHM_RING_H
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <climits>
+#include <cstdint>
+
+#include <signal.h>
+#include <unistd.h>
+
+#include "futex.h"
+
+// Shared memory segment between the client and do_lib. It holds SHM_SLOTS slots that each carry
+// one request and its response, so commands from several client threads can be queued at once.
+// Every hand-off is a store to the slot's state word, futex calls are only made when the other
+// side went to sleep waiting for it.
+//
+// Slot life: FREE -> CLAIMED (client writes the request) -> REQUEST -> BUSY (server handles it)
+// -> DONE (client reads the response) -> FREE. A client that gives up turns BUSY into ABANDONED
+// and the server frees the slot once it's done with it.
+//
+// The server closes the ring before it removes the segment, Ready() turns false for good and
+// clients connect again to whatever segment the server creates next.
+
+#define SHM_RING_MAGIC 0x33474e4952424b44ULL
+
+#define SHM_SLOTS 8
+#define SHM_ARENA_SIZE (512 * 1024)
+
+#define SHM_MAX_MESSAGE_TYPES 32
+
+// Polls before falling back to a futex wait, a few microseconds. Enough for the other side to
+// pick up a hand-off when it's already running on another core.
+#define SHM_SPIN_COUNT 256
+
+class ShmRing
+{
+public:
+    enum State : uint32_t
+    {
+        FREE,
+        CLAIMED,
+        REQUEST,
+        BUSY,
+        DONE,
+        ABANDONED
+    };
+
+    // When the slot's current request reached each stage, CLOCK_MONOTONIC ns so both processes
+    // agree. The server fills in `started`, the rest is stamped here.
+    struct Timing
+    {
+        uint64_t submitted;
+        uint64_t taken;                     // the server picked it up
+        uint64_t started;                   // its work began, on the game thread for game commands
+        uint64_t finished;
+    };
+
+    struct alignas(64) Slot
+    {
+        std::atomic<uint32_t> state;
+        std::atomic<uint32_t> waiting;      // client threads sleeping on state
+        std::atomic<int32_t> owner;         // client pid while it holds the slot, lets a dead client's slots be taken back
+        uint64_t order;                     // requests are handled oldest first
+        Timing timing;
+
+        alignas(64) uint8_t arena[SHM_ARENA_SIZE];   // request frame, then the response over it
+    };
+
+    // Published by the server along with the magic, a client checks it against what it was
+    // built with before sending anything
+    struct Handshake
+    {
+        uint32_t version;
+        uint32_t capabilities;
+        int32_t server_pid;
+        uint32_t message_types;
+        uint32_t message_sizes[SHM_MAX_MESSAGE_TYPES];     // indexed by message type
+    };
+
+    // Only the server calls this. Arenas aren't touched so pages nobody uses stay unallocated.
+    void Reset(const Handshake &handshake)
+    {
+        m_magic = 0;
+        m_handshake = handshake;
+        m_requests = 0;
+        m_server_waiting = 0;
+        m_next_order = 0;
+        m_released = 0;
+        m_acquire_waiters = 0;
+        m_completed = 0;
+        m_completion_waiters = 0;
+        for (auto &slot : m_slots)
+        {
+            slot.state = FREE;
+            slot.waiting = 0;
+            slot.owner = 0;
+            slot.order = 0;
+            slot.timing = { };
+        }
+        m_magic.store(SHM_RING_MAGIC, std::memory_order_release);
+    }
+
+    // False before the server published the ring and again once it closed it
+    inline bool Ready() const { return m_magic.load(std::memory_order_acquire) == SHM_RING_MAGIC; }
+
+    // Only valid once Ready()
+    inline const Handshake &Peer() const { return m_handshake; }
+
+    inline Slot &At(int slot) { return m_slots[slot]; }
+
+    inline bool Done(int slot) const { return m_slots[slot].state.load(std::memory_order_acquire) == DONE; }
+
+    // steady_clock is CLOCK_MONOTONIC on Linux, the same in every process
+    static inline uint64_t Now()
+    {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // Client side
+
+    // Returns a slot index or -1 if every slot stayed taken until the deadline or the ring was closed
+    template <typename Deadline>
+    int Acquire(Deadline deadline)
+    {
+        while (true)
+        {
+            uint32_t released = m_released.load();
+            if (!Ready())
+            {
+                return -1;
+            }
+            for (int i = 0; i < SHM_SLOTS; i++)
+            {
+                if (try_claim(i))
+                {
+                    return i;
+                }
+            }
+
+            if (reclaim_dead())
+            {
+                continue;
+            }
+
+            m_acquire_waiters++;
+            bool ok = futex_wait(m_released, released, deadline);
+            m_acquire_waiters--;
+            if (!ok)
+            {
+                return -1;
+            }
+        }
+    }
+
+    void Submit(int slot)
+    {
+        auto &s = m_slots[slot];
+        s.order = m_next_order++;
+        s.timing = { Now(), 0, 0, 0 };
+        s.state = REQUEST;
+
+        m_requests++;
+        if (m_server_waiting)
+        {
+            futex_wake(m_requests, 1);
+        }
+    }
+
+    // Waits for the response, false on timeout. The slot still has to be released or abandoned.
+    template <typename Deadline>
+    bool Wait(int slot, Deadline deadline)
+    {
+        auto &s = m_slots[slot];
+        if (spin([&] { return s.state == DONE; }))
+        {
+            return true;
+        }
+
+        while (true)
+        {
+            s.waiting++;
+            uint32_t state = s.state;
+            if (state == DONE)
+            {
+                s.waiting--;
+                return true;
+            }
+            // Close only wakes whoever already sleeps, a ring closed before that never answers
+            if (!Ready())
+            {
+                s.waiting--;
+                return false;
+            }
+            bool ok = futex_wait(s.state, state, deadline);
+            s.waiting--;
+            if (!ok || !Ready())
+            {
+                return s.state == DONE;
+            }
+        }
+    }
+
+    // Bumped every time a request is answered, read it before checking a set of slots
+    // and hand it to WaitCompletion to sleep until any of them may have finished
+    inline uint32_t Completions() const { return m_completed; }
+
+    template <typename Deadline>
+    bool WaitCompletion(uint32_t seen, Deadline deadline)
+    {
+        m_completion_waiters++;
+        bool ok = m_completed != seen || !Ready() || futex_wait(m_completed, seen, deadline);
+        m_completion_waiters--;
+        return ok;
+    }
+
+    void Release(int slot)
+    {
+        m_slots[slot].owner = 0;
+        m_slots[slot].state = FREE;
+        released();
+    }
+
+    // Gives the slot up after a timeout, the server frees it if it's still working on it
+    void Abandon(int slot)
+    {
+        auto &s = m_slots[slot];
+        s.owner = 0;
+
+        uint32_t expected = REQUEST;
+        if (s.state.compare_exchange_strong(expected, FREE))
+        {
+            released();
+            return;
+        }
+
+        expected = BUSY;
+        if (!s.state.compare_exchange_strong(expected, ABANDONED))
+        {
+            // Finished in the meantime
+            Release(slot);
+        }
+    }
+
+    // Server side
+
+    // Oldest pending request, now BUSY, or -1 if none came in before the deadline or Wake was called
+    template <typename Deadline>
+    int Take(Deadline deadline)
+    {
+        int slot = -1;
+        if (spin([&] { return (slot = take_oldest()) >= 0; }))
+        {
+            return slot;
+        }
+
+        uint32_t requests = m_requests;
+        if ((slot = take_oldest()) >= 0)
+        {
+            return slot;
+        }
+
+        m_server_waiting = 1;
+        if (m_requests == requests)
+        {
+            futex_wait(m_requests, requests, deadline);
+        }
+        m_server_waiting = 0;
+
+        return take_oldest();
+    }
+
+    void Complete(int slot)
+    {
+        auto &s = m_slots[slot];
+        s.timing.finished = Now();
+
+        uint32_t expected = BUSY;
+        if (s.state.compare_exchange_strong(expected, DONE))
+        {
+            m_completed++;
+            if (s.waiting)
+            {
+                futex_wake(s.state, INT_MAX);
+            }
+            if (m_completion_waiters)
+            {
+                futex_wake(m_completed, INT_MAX);
+            }
+            return;
+        }
+
+        // The client gave up on it
+        s.state = FREE;
+        released();
+    }
+
+    // Makes a sleeping Take return, e.g. to shut the server down
+    void Wake()
+    {
+        m_requests++;
+        futex_wake(m_requests, INT_MAX);
+    }
+
+    // Once the server stopped taking requests and answered the ones it had. Wakes every client
+    // that sleeps on the ring so it notices Ready() is false.
+    void Close()
+    {
+        m_magic.store(0, std::memory_order_release);
+
+        m_released++;
+        futex_wake(m_released, INT_MAX);
+        m_completed++;
+        futex_wake(m_completed, INT_MAX);
+        for (auto &slot : m_slots)
+        {
+            futex_wake(slot.state, INT_MAX);
+        }
+    }
+
+private:
+    bool try_claim(int slot)
+    {
+        auto &s = m_slots[slot];
+        uint32_t expected = FREE;
+        if (s.state.load(std::memory_order_relaxed) != FREE || !s.state.compare_exchange_strong(expected, CLAIMED))
+        {
+            return false;
+        }
+        s.owner = getpid();
+        return true;
+    }
+
+    // Slots a client held when it died would otherwise stay taken forever
+    bool reclaim_dead()
+    {
+        bool any = false;
+        for (auto &s : m_slots)
+        {
+            uint32_t state = s.state;
+            if (state != CLAIMED && state != DONE)
+            {
+                continue;
+            }
+
+            pid_t owner = s.owner;
+            if (owner > 0 && kill(owner, 0) == -1 && errno == ESRCH && s.state.compare_exchange_strong(state, FREE))
+            {
+                any = true;
+            }
+        }
+        return any;
+    }
+
+    int take_oldest()
+    {
+        int oldest = -1;
+        for (int i = 0; i < SHM_SLOTS; i++)
+        {
+            if (m_slots[i].state.load(std::memory_order_acquire) == REQUEST &&
+                    (oldest < 0 || m_slots[i].order < m_slots[oldest].order))
+            {
+                oldest = i;
+            }
+        }
+
+        uint32_t expected = REQUEST;
+        if (oldest >= 0 && m_slots[oldest].state.compare_exchange_strong(expected, BUSY))
+        {
+            m_slots[oldest].timing.taken = Now();
+            return oldest;
+        }
+        return -1;
+    }
+
+    void released()
+    {
+        m_released++;
+        if (m_acquire_waiters)
+        {
+            futex_wake(m_released, 1);
+        }
+    }
+
+    // With a single core the other side can't run while we poll, go straight to the futex
+    template <typename F>
+    static bool spin(F &&done)
+    {
+        static const int count = sysconf(_SC_NPROCESSORS_ONLN) > 1 ? SHM_SPIN_COUNT : 0;
+
+        for (int i = 0; i < count; i++)
+        {
+            if (done())
+            {
+                return true;
+            }
+#if defined(__x86_64__) || defined(__i386__)
+            __builtin_ia32_pause();
+#endif
+        }
+        return false;
+    }
+
+    std::atomic<uint64_t> m_magic;
+    Handshake m_handshake;
+
+    alignas(64) std::atomic<uint32_t> m_requests;       // bumped on every submit, the server sleeps on it
+    std::atomic<uint32_t> m_server_waiting;
+    std::atomic<uint64_t> m_next_order;
+
+    alignas(64) std::atomic<uint32_t> m_released;       // bumped whenever a slot is freed
+    std::atomic<uint32_t> m_acquire_waiters;
+
+    alignas(64) std::atomic<uint32_t> m_completed;
+    std::atomic<uint32_t> m_completion_waiters;
+
+    Slot m_slots[SHM_SLOTS];
+};
+
+static_assert(std::atomic<uint32_t>::is_always_lock_free && std::atomic<uint64_t>::is_always_lock_free,
+        "The ring is shared between processes, its atomics can't use locks");
+
+#endif /* SHM_RING_H */
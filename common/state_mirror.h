@@ -0,0 +1,124 @@
+#ifndef STATE_MIRROR_H
+#define STATE_MIRROR_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+
+// Snapshot of the hot game state do_lib writes on every GuiManager tick, so the client reads a
+// whole tick's worth with a memcpy instead of hundreds of cross process reads that can straddle
+// a frame. Guarded by a seqlock: the game thread never waits, a reader retries if a write
+// overlapped its copy. do_lib only fills it while a client has read it recently.
+
+#define MIRROR_MAX_SHIPS 1024
+
+// do_lib stops writing once nobody read for this long
+#define MIRROR_LEASE_NS 5000000000ULL
+
+// CLOCK_MONOTONIC in ns, served by the vdso so neither side makes a syscall for it
+inline uint64_t mirror_now_ns()
+{
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+}
+
+struct MirrorShip
+{
+    uint32_t id;
+    uint32_t visible;
+    double x, y;
+    uint64_t object;
+};
+
+struct MirrorFrame
+{
+    uint64_t tick;              // 0 until the first write
+    uint64_t time_ns;           // CLOCK_MONOTONIC
+    uint64_t player_object;     // 0 if there's no player ship
+    uint32_t player_id;
+    uint32_t ship_count;
+    double player_x, player_y;
+
+    MirrorShip ships[MIRROR_MAX_SHIPS];
+};
+
+static_assert(sizeof(MirrorShip) == 32 && offsetof(MirrorFrame, ships) == 48, "MirrorFrame layout changed");
+
+class StateMirror
+{
+public:
+    // Only the server calls this, before the command ring's magic is published
+    void Reset()
+    {
+        m_sequence = 0;
+        m_last_read_ns = 0;
+        m_frame.tick = 0;
+        m_frame.ship_count = 0;
+    }
+
+    // Writer side, the game thread
+
+    inline bool Wanted(uint64_t now_ns) const
+    {
+        uint64_t last_read = m_last_read_ns.load(std::memory_order_relaxed);
+        return last_read && now_ns - last_read < MIRROR_LEASE_NS;
+    }
+
+    // Fill the frame in between, keep it short
+    MirrorFrame &BeginWrite()
+    {
+        m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return m_frame;
+    }
+
+    void EndWrite()
+    {
+        m_sequence.store(m_sequence.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+    // Reader side
+
+    // Copies a consistent frame, only the ships in use. False if every attempt overlapped a write
+    // or there's no recent frame, which is the case for a tick after the first read.
+    bool Read(MirrorFrame &out, int attempts = 16)
+    {
+        uint64_t now = mirror_now_ns();
+        m_last_read_ns.store(now, std::memory_order_relaxed);
+
+        for (int i = 0; i < attempts; i++)
+        {
+            uint32_t sequence = m_sequence.load(std::memory_order_acquire);
+            if (sequence & 1)
+            {
+#if defined(__x86_64__) || defined(__i386__)
+                __builtin_ia32_pause();
+#endif
+                continue;
+            }
+
+            std::memcpy(&out, &m_frame, offsetof(MirrorFrame, ships));
+            out.ship_count = std::min<uint32_t>(out.ship_count, MIRROR_MAX_SHIPS);
+            std::memcpy(out.ships, m_frame.ships, out.ship_count * sizeof(MirrorShip));
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (m_sequence.load(std::memory_order_relaxed) == sequence)
+            {
+                return out.tick != 0 && out.time_ns + MIRROR_LEASE_NS > now;
+            }
+        }
+        return false;
+    }
+
+private:
+    alignas(64) std::atomic<uint32_t> m_sequence;       // odd while a write is in progress
+    std::atomic<uint64_t> m_last_read_ns;               // set by the client
+
+    alignas(64) MirrorFrame m_frame;
+};
+
+#endif /* STATE_MIRROR_H */
@@ -1,7 +1,114 @@
 #include "avm.h"
 #include "binary_stream.h"
+#include "maps_parser.h"
 #include "utils.h"
 
+#include <algorithm>
+#include <functional>
+#include <string_view>
+#include <utility>
+
+typedef std::vector<std::pair<uintptr_t, uintptr_t>> Ranges;
+
+// GC blocks live in anonymous rw memory, c++ vtables in the read only part of a module.
+// Game thread only, the maps are read every time but only parsed again when they changed.
+static void get_heap_ranges(const Ranges *&heap, const Ranges *&images)
+{
+    static MapsParser parser;
+    static size_t length = 0, hash = 0;
+    static Ranges heap_ranges, image_ranges;
+
+    heap = &heap_ranges;
+    images = &image_ranges;
+
+    if (!parser.Read(0))
+    {
+        return;
+    }
+
+    size_t new_hash = std::hash<std::string_view>()(parser.Raw());
+    if (parser.Raw().size() == length && new_hash == hash)
+    {
+        return;
+    }
+    length = parser.Raw().size();
+    hash = new_hash;
+
+    parser.Parse();
+    heap_ranges.clear();
+    image_ranges.clear();
+    for (auto &region : parser.Regions())
+    {
+        if (region.read != 'r')
+        {
+            continue;
+        }
+        if (region.write == 'w' && region.name.empty())
+        {
+            heap_ranges.emplace_back(region.start, region.end);
+        }
+        else if (region.write == '-' && !region.name.empty() && region.name[0] == '/')
+        {
+            image_ranges.emplace_back(region.start, region.end);
+        }
+    }
+}
+
+static bool in_ranges(const Ranges &ranges, uintptr_t address)
+{
+    auto it = std::upper_bound(ranges.begin(), ranges.end(), address, [] (uintptr_t a, const std::pair<uintptr_t, uintptr_t> &r)
+    {
+        return a < r.first;
+    });
+    return it != ranges.begin() && address < (--it)->second;
+}
+
+bool avm::walk_objects(GC *gc, const std::function<bool(ScriptObject *)> &f)
+{
+    const Ranges *heap, *images;
+    get_heap_ranges(heap, images);
+
+    auto is_gc_object = [&] (void *ptr)
+    {
+        uintptr_t address = reinterpret_cast<uintptr_t>(ptr);
+        return address && (address & 7) == 0 && in_ranges(*heap, address) && get_block_header(ptr)->gc == gc;
+    };
+
+    for (auto &[start, end] : *heap)
+    {
+        for (uintptr_t block = start; block < end; block += GC_BLOCK_SIZE)
+        {
+            auto *header = reinterpret_cast<BlockHeader *>(block);
+            uint32_t size = header->size;
+
+            if (header->gc != gc || size < sizeof(ScriptObject) || size % 8 || size > GC_BLOCK_SIZE - sizeof(BlockHeader))
+            {
+                continue;
+            }
+
+            for (uintptr_t item = block + GC_BLOCK_SIZE - size; item >= block + sizeof(BlockHeader); item -= size)
+            {
+                auto *obj = reinterpret_cast<ScriptObject *>(item);
+
+                // Free items hold the free list link where the c++ vtable would be. Items the
+                // collector found dead but didn't sweep yet still look alive.
+                if (!in_ranges(*images, reinterpret_cast<uintptr_t>(obj->vt))
+                    || !is_gc_object(obj->vtable)
+                    || !is_gc_object(obj->vtable->traits))
+                {
+                    continue;
+                }
+
+                if (!f(obj))
+                {
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
 avm::ClassClosure * avm::AbcEnv::finddef(const std::string &name)
 {
     return finddef([name] (avm::ClassClosure *closure)
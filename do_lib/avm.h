@@ -137,6 +137,23 @@ namespace avm
         return reinterpret_cast<BlockHeader *>(uintptr_t(obj) & (~(4096LL-1LL)));
     }
 
+    const size_t GC_BLOCK_SIZE = 4096;
+
+    // Small object blocks pack their items against the end of the block, so every item
+    // starts a multiple of the item size away from it
+    inline static bool is_block_item(void *obj)
+    {
+        uintptr_t size = get_block_header(obj)->size;
+        return size && (GC_BLOCK_SIZE - (uintptr_t(obj) & (GC_BLOCK_SIZE - 1))) % size == 0;
+    }
+
+    // Calls f for every live ScriptObject allocated in a small object block of `gc`.
+    // Blocks are walked item by item, large objects (bigger than a block) are not visited.
+    // Liveness is only guessed from the item's vtables, mark bits aren't read, so objects that
+    // died but weren't swept yet are visited too. Returns false if f stopped the walk.
+    // Must run on the game thread.
+    bool walk_objects(GC *gc, const std::function<bool(ScriptObject *)> &f);
+
     struct String : public GCObject
     {
         uintptr_t vtable;
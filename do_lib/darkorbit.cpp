@@ -23,6 +23,8 @@ uintptr_t hook_proxy(avm::MethodEnv *env, uint32_t argc, uintptr_t *argv)
 
     hook.handler(env, argc, argv);
 
+    Darkorbit::get().post_event(EVENT_HOOK, env->method_info->id, avm::remove_kind(argv[0]));
+
     // Call original
     uintptr_t r = 0;
     Atom this_object = argv[0];
@@ -120,6 +122,8 @@ void Darkorbit::notify_jit(avm::MethodInfo *method)
 
 void Darkorbit::notify_freechunk(uintptr_t chunk)
 {
+    post_event(EVENT_CHUNK_FREED, 0, chunk);
+
     for (auto &[id, hook] : m_hooks)
     {
         if ((reinterpret_cast<uintptr_t>(hook.method) & ~0xfff) == chunk)
@@ -148,6 +152,41 @@ std::unordered_map<uint32_t, game::Ship *> Darkorbit::get_ships()
     return r;
 }
 
+std::vector<avm::ScriptObject *> Darkorbit::find_instances(const std::string &class_name, size_t max,
+        std::unordered_map<avm::Traits *, size_t> *census)
+{
+    std::vector<avm::ScriptObject *> r;
+
+    // Reading a name means decoding a string, do it once per class
+    std::unordered_map<avm::Traits *, bool> matches;
+
+    avm::walk_objects(avm::get_block_header(m_main)->gc, [&] (avm::ScriptObject *obj)
+    {
+        avm::Traits *traits = obj->vtable->traits;
+
+        if (census)
+        {
+            (*census)[traits]++;
+        }
+
+        auto it = matches.find(traits);
+        if (it == matches.end())
+        {
+            it = matches.emplace(traits, !class_name.empty() && traits->name() == class_name).first;
+        }
+
+        if (it->second && (!max || r.size() < max))
+        {
+            r.push_back(obj);
+        }
+
+        // Keep going for the census even when there are enough instances
+        return census || !max || r.size() < max;
+    });
+
+    return r;
+}
+
 std::future<uintptr_t> Darkorbit::call_sync(const std::function<uintptr_t()> &f)
 {
     std::scoped_lock lk { m_call_mut };
@@ -156,12 +195,100 @@ std::future<uintptr_t> Darkorbit::call_sync(const std::function<uintptr_t()> &f)
 
 void Darkorbit::handle_async_calls(avm::MethodEnv *env, uint32_t argc, uintptr_t *argv)
 {
-    std::scoped_lock lk { m_call_mut };
-    for (auto &task : m_async_calls)
+    // Run them unlocked, call_sync shouldn't have to wait for a slow task to queue the next one
+    std::vector<std::packaged_task<uintptr_t()>> calls;
+    {
+        std::scoped_lock lk { m_call_mut };
+        calls.swap(m_async_calls);
+    }
+
+    for (auto &task : calls)
     {
         task();
     }
-    m_async_calls.clear();
+
+    update_shared_state();
+}
+
+void Darkorbit::update_shared_state()
+{
+    uint64_t now = mirror_now_ns();
+
+    bool track = m_ipc.WantsEvent(EVENT_ENTITY_ADDED) || m_ipc.WantsEvent(EVENT_ENTITY_REMOVED);
+    bool mirror = m_ipc.Mirror() && m_ipc.Mirror()->Wanted(now);
+
+    if (!track)
+    {
+        // Whoever subscribes next gets every ship already there as added
+        m_known_ships.clear();
+    }
+    if (!track && !mirror)
+    {
+        return;
+    }
+
+    auto ships = get_ships();
+    if (mirror)
+    {
+        write_mirror(ships, now);
+    }
+    if (track)
+    {
+        track_entities(std::move(ships));
+    }
+}
+
+void Darkorbit::write_mirror(const std::unordered_map<uint32_t, game::Ship *> &ships, uint64_t now_ns)
+{
+    // The AS3 call stays out of the write, readers retry for as long as it lasts
+    auto *player = reinterpret_cast<game::Ship *>(avm::remove_kind(m_event_manager->call(7)));
+
+    StateMirror *mirror = m_ipc.Mirror();
+    MirrorFrame &frame = mirror->BeginWrite();
+
+    frame.tick = ++m_mirror_tick;
+    frame.time_ns = now_ns;
+    frame.player_object = reinterpret_cast<uintptr_t>(player);
+    frame.player_id = player ? player->id : 0;
+    frame.player_x = player && player->location_info ? player->location_info->x : -1;
+    frame.player_y = player && player->location_info ? player->location_info->y : -1;
+
+    frame.ship_count = 0;
+    for (auto &[id, ship] : ships)
+    {
+        if (frame.ship_count == MIRROR_MAX_SHIPS)
+        {
+            break;
+        }
+
+        MirrorShip &entry = frame.ships[frame.ship_count++];
+        entry.id = id;
+        entry.visible = ship->visible;
+        entry.x = ship->location_info ? ship->location_info->x : -1;
+        entry.y = ship->location_info ? ship->location_info->y : -1;
+        entry.object = reinterpret_cast<uintptr_t>(ship);
+    }
+
+    mirror->EndWrite();
+}
+
+void Darkorbit::track_entities(std::unordered_map<uint32_t, game::Ship *> ships)
+{
+    for (auto &[id, ship] : ships)
+    {
+        if (!m_known_ships.count(id))
+        {
+            post_event(EVENT_ENTITY_ADDED, id, reinterpret_cast<uintptr_t>(ship));
+        }
+    }
+    for (auto &[id, ship] : m_known_ships)
+    {
+        if (!ships.count(id))
+        {
+            post_event(EVENT_ENTITY_REMOVED, id, reinterpret_cast<uintptr_t>(ship));
+        }
+    }
+    m_known_ships.swap(ships);
 }
 
 bool Darkorbit::mouse_click(int x, int y, int button)
@@ -378,6 +505,11 @@ bool Darkorbit::install(uintptr_t main_app_address)
     utils::log("[+] Screen {x}\n", m_screen_manager);
     utils::log("[+] Event {x}\n", m_event_manager);
 
+    if (!avm::is_block_item(m_main))
+    {
+        utils::log("[!] Unexpected GC block layout, instance lookups won't find anything\n");
+    }
+
     auto vtable          = m_main->get_at<uintptr_t>(0x10);
     auto vtable_init     = memory::read<uintptr_t>(vtable + 0x10);
     auto vtable_scope    = memory::read<uintptr_t>(vtable_init + 0x18);
@@ -431,6 +563,7 @@ bool Darkorbit::install(uintptr_t main_app_address)
         // ....
     }
 
+    post_event(EVENT_INSTALL, 0, reinterpret_cast<uintptr_t>(m_main));
     return (m_installed = true);
 }
 
@@ -446,7 +579,9 @@ bool Darkorbit::uninstall()
 
     m_refine_multiname = 0;
     m_item_prop_mn = 0;
+    m_known_ships.clear();
 
+    post_event(EVENT_UNINSTALL);
 
     m_ipc.Remove();
     m_installed = false;
@@ -161,10 +161,21 @@ public:
 
     std::unordered_map<uint32_t, game::Ship *> get_ships();
 
+    // Live instances of the class named `class_name`, found by walking the GC heap. If census
+    // is set it gets the live object count of every class seen. Objects that died since the last
+    // sweep are included, see avm::walk_objects. Game thread only.
+    std::vector<avm::ScriptObject *> find_instances(const std::string &class_name, size_t max = 0,
+            std::unordered_map<avm::Traits *, size_t> *census = nullptr);
+
     void notify_jit(avm::MethodInfo *method);
 
     void notify_freechunk(uintptr_t chunk);
 
+    inline void post_event(EventType type, uint32_t id = 0, uint64_t value = 0)
+    {
+        m_ipc.PostEvent(type, id, value);
+    }
+
     FlashHook &gethook(uint32_t id) { return m_hooks[id]; };
 
     auto &get_hooks() { return m_hooks; }
@@ -193,6 +204,12 @@ private:
 
     void handle_async_calls(avm::MethodEnv *env, uint32_t argc, uintptr_t *argv) ;
 
+    // Once per tick, reads the ships only if the client listens for entity events or reads the mirror
+    void update_shared_state();
+    // Diffs the ship list against the last tick's
+    void track_entities(std::unordered_map<uint32_t, game::Ship *> ships);
+    void write_mirror(const std::unordered_map<uint32_t, game::Ship *> &ships, uint64_t now_ns);
+
 
 
     std::unordered_map<uint32_t, FlashHook> m_hooks;
@@ -203,6 +220,9 @@ private:
     Ipc m_ipc;
     bool m_installed = false;
 
+    std::unordered_map<uint32_t, game::Ship *> m_known_ships;
+    uint64_t m_mirror_tick = 0;
+
     uint32_t m_refine_multiname = 0;
     uint32_t m_item_prop_mn = 0;
 
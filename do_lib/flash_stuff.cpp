@@ -61,7 +61,13 @@ uintptr_t get_input_param()
     static uintptr_t input_param = 0;
     if (!input_param)
     {
-        uintptr_t input_thing_vtable = memory::get_pages("libpepflashplayer").at(0).start + offsets::input_thing_vt;
+        const memory::Module *flash = memory::get_module("libpepflashplayer");
+        if (!flash)
+        {
+            return 0;
+        }
+
+        uintptr_t input_thing_vtable = flash->base + offsets::input_thing_vt;
         uintptr_t input_thing = memory::query_memory(reinterpret_cast<uint8_t *>(&input_thing_vtable), sizeof(uintptr_t), 8);
 
         if (!input_thing)
@@ -134,16 +140,25 @@ avm::MethodSignature *flash_stuff::get_method_signature(avm::MethodInfo *mi)
 
 bool flash_stuff::install()
 {
-    uintptr_t base = 0;
-    try
-    {
-        base = memory::get_pages("libpepflashplayer").at(0).start;
-    }
-    catch (...)
+    const memory::Module *flash = memory::get_module("libpepflashplayer");
+    if (!flash)
     {
         utils::log("[!] Failed to find flash lib");
         return false;
     }
+    uintptr_t base = flash->base;
+
+    // With a flash build the offsets weren't taken from, hooks would be patched into whatever is there
+    for (auto offset : { offsets::verifyjit, offsets::free_chunk, offsets::getproperty, offsets::setproperty,
+            offsets::get_traits_binding, offsets::newarray, offsets::newstring, offsets::finddef,
+            offsets::mouse_release, offsets::mouse_press, offsets::get_method_sig })
+    {
+        if (!flash->contains_code(base + offset))
+        {
+            utils::log("[!] Offset {x} isn't in flash's code, unsupported flash version\n", offset);
+            return false;
+        }
+    }
 
     verify_jit_hook = new subhook::Hook(
                 reinterpret_cast<void *>(base + offsets::verifyjit),
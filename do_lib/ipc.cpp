@@ -1,178 +1,190 @@
 #include "ipc.h"
 
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
 #include <cstdio>
 #include <cstring>
+#include <ctime>
+#include <memory>
+#include <utility>
 
 #include <unistd.h>
 #include <sys/shm.h>
 #include <sys/ipc.h>
-#include <sys/sem.h>
 
 #include "darkorbit.h"
 #include "flash_stuff.h"
 #include "memory.h"
+#include "protocol.h"
+#include "shm_ring.h"
 #include "utils.h"
 
-#define MEM_SIZE 1024
+// Addresses and entries go after the fixed fields of the response, up to the end of the arena
+#define MAX_SCAN_RESULTS ((SHM_ARENA_SIZE - sizeof(ScanMessage)) / sizeof(uintptr_t))
+#define MAX_INSTANCES ((SHM_ARENA_SIZE - sizeof(InstancesMessage)) / sizeof(uintptr_t))
+#define MAX_CENSUS_ENTRIES ((SHM_ARENA_SIZE - sizeof(CensusMessage)) / sizeof(CensusEntry))
 
 using namespace std::chrono_literals;
 
-union semun
-{ 
-    int                 val;
-    struct semid_ds *   buf;
-    unsigned short *    array;
-#if defined(__linux__)
-    struct seminfo *    __buf;
-#endif
-};
-
-enum class MessageType
-{
-    CALL,
-    RESULT,
-    SEND_NOTIFICATION,
-    REFINE,
-    UPGRADE,
-    USE_ITEM,
-    KEY_CLICK,
-    MOUSE_CLICK,
-    CHECK_SIGNATURE,
-    NONE
-
-};
-
-struct RefineMessage
-{
-    MessageType type = MessageType::REFINE;
-    uintptr_t refine_util;
-    int ore, amount;
-};
-
-struct SendNotificationMessage
+static void fail(MessageHeader *message)
 {
-    MessageType type = MessageType::SEND_NOTIFICATION;
-    char name[64];
-    uint32_t argc;
-    uintptr_t argv[64];
-};
-
-struct FunctionResultMessage
-{
-    MessageType type = MessageType::RESULT;
-    bool error = false;
-    uintptr_t value;
-};
-
-struct CallFunctionMessage
-{
-    MessageType type = MessageType::CALL;;
-    avm::ScriptObject *object;
-    uint32_t index;
-    int argc;
-    uintptr_t argv[64];
-};
+    message->error = 1;
+    if (message->type == MessageType::CHECK_SIGNATURE)
+    {
+        reinterpret_cast<CheckSignatureMessage *>(message)->result = -1;
+    }
+}
 
-struct UseItemMessage
+// Game thread only, the frame was checked with valid_frame. Writes the response over the message,
+// commands without a result value are left as they are when they succeed.
+static void run_game_command(MessageHeader *message)
 {
-    MessageType type = MessageType::USE_ITEM;
-    char name[64];
-    uint8_t action_type;
-    bool action_bar;
-
-    // ItemsControlMenuConstants.ACTION_SELECTION == 1
-    // ItemsControlMenuConstants.ACTION_TOOGLE == 0
-    // ItemsControlMenuConstants.ACTION_ONE_SHOT == 1
-    // barId = _loc2_.barId == CATEGORY_BAR ? 0 : 1;
+    auto &darkorbit = Darkorbit::get();
 
-};
+    switch (message->type)
+    {
+        case MessageType::CALL:
+        {
+            auto *call = reinterpret_cast<CallFunctionMessage *>(message);
 
-struct KeyClickMessage
-{
-    MessageType type = MessageType::KEY_CLICK;
-    uint32_t key;
-};
+            if (!call->object)
+            {
+                utils::log("[Ipc::run_game_command] null object\n");
+                fail(message);
+                break;
+            }
 
-struct MouseClickMessage
-{
-    MessageType type = MessageType::MOUSE_CLICK;
-    uint32_t button;
-    int32_t x;
-    int32_t y;
-};
+            if (call->argc > tail_size(call) / sizeof(uintptr_t))
+            {
+                utils::log("[Ipc::run_game_command] argc too big {x}\n", static_cast<int>(message->type));
+                fail(message);
+                break;
+            }
 
-struct CheckSignatureMessage
-{
-    MessageType type = MessageType::CHECK_SIGNATURE;;
-    avm::ScriptObject *object;
-    uint32_t index;
-    bool method_name;
-    char signature[0x100];
+            auto *object = reinterpret_cast<avm::ScriptObject *>(call->object);
+            auto value = object->call_method(call->index, call->argc, tail<uintptr_t>(call));
 
-    int32_t result;
-};
+            auto *result = reinterpret_cast<FunctionResultMessage *>(message);
+            result->header.type = MessageType::RESULT;
+            result->header.size = sizeof(FunctionResultMessage);
+            result->value = value;
+            break;
+        }
+        case MessageType::SEND_NOTIFICATION:
+        {
+            auto *msg = reinterpret_cast<SendNotificationMessage *>(message);
 
-union Message
-{
-    Message() { };
-    MessageType type = MessageType::NONE;;
-    CallFunctionMessage call;
-    FunctionResultMessage result;
-    SendNotificationMessage notify;
-    RefineMessage refine;
-    UseItemMessage item;
-    KeyClickMessage key;
-    MouseClickMessage click;
-    CheckSignatureMessage sig;
-};
+            if (msg->argc * sizeof(uintptr_t) + msg->name_length > tail_size(msg))
+            {
+                utils::log("[Ipc::run_game_command] argc too big {x}\n", static_cast<int>(message->type));
+                fail(message);
+                break;
+            }
 
-static_assert(sizeof(Message) < MEM_SIZE, "Message is larger than the allocated shared memory");
+            auto *argv = tail<uintptr_t>(msg);
+            std::string name(reinterpret_cast<const char *>(argv + msg->argc), msg->name_length);
+            darkorbit.send_notification(name, std::vector<Atom>(argv, argv + msg->argc));
+            break;
+        }
+        case MessageType::USE_ITEM:
+        {
+            auto *msg = reinterpret_cast<UseItemMessage *>(message);
+            if (msg->name_length > tail_size(msg))
+            {
+                fail(message);
+                break;
+            }
+            darkorbit.use_item(std::string(tail<const char>(msg), msg->name_length), 0, 1);
+            break;
+        }
+        case MessageType::REFINE:
+        {
+            auto *msg = reinterpret_cast<RefineMessage *>(message);
+            darkorbit.refine_ore(msg->ore, msg->amount);
+            break;
+        }
+        case MessageType::KEY_CLICK:
+            darkorbit.key_click(reinterpret_cast<KeyClickMessage *>(message)->key);
+            break;
+        case MessageType::MOUSE_CLICK:
+        {
+            auto *msg = reinterpret_cast<MouseClickMessage *>(message);
+            darkorbit.mouse_click(msg->x, msg->y, msg->button);
+            break;
+        }
+        case MessageType::CHECK_SIGNATURE:
+        {
+            auto *msg = reinterpret_cast<CheckSignatureMessage *>(message);
+            if (msg->signature_length > tail_size(msg))
+            {
+                fail(message);
+                break;
+            }
+            msg->result = darkorbit.check_method_signature(reinterpret_cast<avm::ScriptObject *>(msg->object), msg->index,
+                    msg->method_name, std::string(tail<const char>(msg), msg->signature_length));
+            break;
+        }
+        default:
+            utils::log("[Ipc::run_game_command] {x} can't run on the game thread\n", static_cast<int>(message->type));
+            fail(message);
+            break;
+    }
+}
 
 bool Ipc::Init()
 {
     pid_t pid = getpid();
 
-    if ((m_shmid = shmget(pid, MEM_SIZE, IPC_CREAT | 0666)) < 0)
+    m_shmid = shmget(pid, sizeof(SharedSegment), IPC_CREAT | 0666);
+    if (m_shmid < 0 && errno == EINVAL)
     {
-        utils::log("[Ipc::init] Failed to get shared memory: {}\n", strerror(errno));
-        return false;
+        // Left behind by a build with a smaller segment, no client can use it anyway
+        int stale = shmget(pid, 0, 0);
+        if (stale >= 0 && shmctl(stale, IPC_RMID, NULL) == 0)
+        {
+            utils::log("[Ipc::init] Removed stale shared memory {}\n", stale);
+            m_shmid = shmget(pid, sizeof(SharedSegment), IPC_CREAT | 0666);
+        }
     }
 
-    if ((m_sem = semget(pid, 2, IPC_CREAT | 0666)) < 0)
+    if (m_shmid < 0)
     {
-        utils::log("[Ipc::init] Failed to create shared semaphore: {}\n", strerror(errno));
+        utils::log("[Ipc::init] Failed to get shared memory: {}\n", strerror(errno));
         return false;
     }
 
-    if ((m_shared = reinterpret_cast<Message *>(shmat(m_shmid, NULL, 0))) == (Message *)-1)
+    void *shared = shmat(m_shmid, NULL, 0);
+    if (shared == (void *)-1)
     {
         utils::log("[Ipc::init] Failed to attach shared memory to our process: {}\n", strerror(errno));
+        shmctl(m_shmid, IPC_RMID, NULL);
         return false;
     }
 
-    if (semctl(m_sem, 0, SETVAL, 1) == -1 || semctl(m_sem, 1, SETVAL, 0) == -1)
+    // Clients don't touch the segment until the ring's magic is there and check the handshake first
+    auto *segment = m_segment = reinterpret_cast<SharedSegment *>(shared);
+    segment->events.Reset();
+    segment->mirror.Reset();
+    m_mirror = &segment->mirror;
     {
-        utils::log("[Ipc::init] semctl failed: {}\n", strerror(errno));
-        return false;
+        std::scoped_lock lk { m_events_mut };
+        m_events = &segment->events;
     }
 
+    m_ring = &segment->ring;
+    m_ring->Reset(protocol_handshake(CAP_SCAN | CAP_INSTANCES | CAP_CENSUS | CAP_BATCH | CAP_EVENTS | CAP_MIRROR, pid));
+
     return true;
 }
 
 void Ipc::Remove()
 {
-    union semun dummy;
-
-    if (m_shared)
+    // Hooks check the pointer without the lock, taking it first leaves them the whole
+    // shutdown to be done with a ring they loaded before it's detached
     {
-        if (shmctl(m_shmid, IPC_RMID, NULL) == -1)
-        {
-            utils::log("[Ipc::Remove] shmctl failed: {}\n", strerror(errno));
-        }
-        if (semctl(m_sem, 0, IPC_RMID, dummy) == -1)
-        {
-            utils::log("[Ipc::Remove] semctl failed: {}\n", strerror(errno));
-        }
+        std::scoped_lock lk { m_events_mut };
+        m_events = nullptr;
     }
 
     if (m_running)
@@ -180,215 +192,378 @@ void Ipc::Remove()
         utils::log("[Ipc::Remove] waiting for runner thread to stop\n");
 
         m_running = false;
+        m_ring->Wake();
         if (m_runner_thread.joinable())
         {
             m_runner_thread.join();
         }
+
+        // The scan in progress stops at its next chunk, queued ones are failed right away
+        {
+            std::scoped_lock lk { m_scans_mut };
+            m_cancel_scans = true;
+        }
+        m_scans_cv.notify_one();
+        if (m_scan_thread.joinable())
+        {
+            m_scan_thread.join();
+        }
     }
+
+    if (!m_segment)
+    {
+        return;
+    }
+
+    // Requests nobody took yet are failed too, then clients find the ring closed
+    for (int slot; (slot = m_ring->Take(std::chrono::steady_clock::now())) >= 0; )
+    {
+        fail(reinterpret_cast<MessageHeader *>(m_ring->At(slot).arena));
+        m_ring->Complete(slot);
+    }
+    m_ring->Close();
+    m_segment->events.Close();
+
+    // The runner failed every request still in flight, game tasks that run later see them
+    // answered and leave the ring alone, so nothing in this process uses the segment anymore
+    m_mirror = nullptr;
+    m_ring = nullptr;
+
+    if (shmctl(m_shmid, IPC_RMID, NULL) == -1)
+    {
+        utils::log("[Ipc::Remove] shmctl failed: {}\n", strerror(errno));
+    }
+    if (shmdt(m_segment) == -1)
+    {
+        utils::log("[Ipc::Remove] shmdt failed: {}\n", strerror(errno));
+    }
+    m_segment = nullptr;
 }
 
-void Ipc::handle_message()
+void Ipc::PostEvent(EventType type, uint32_t id, uint64_t value)
 {
-    if (!m_shared)
+    // Hooks call this on every hit, an unwanted type has to stay a couple of loads
+    if (!WantsEvent(type))
     {
         return;
     }
 
-    auto *result = reinterpret_cast<FunctionResultMessage *>(m_shared);
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    Event event { type, id, static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec, value };
 
-    switch (m_shared->type)
+    std::scoped_lock lk { m_events_mut };
+    if (EventRing *events = m_events.load(std::memory_order_relaxed))
     {
-        case MessageType::CALL:
-        {
-            auto *call = reinterpret_cast<CallFunctionMessage *>(m_shared);
+        events->Push(event);
+    }
+}
 
-            if (!call->object)
-            {
-                utils::log("[Ipc::handle_message] null object\n");
-                result->error = true;
-                result->type = MessageType::RESULT;
-                break;
-            }
+// A request handed to the game thread. Whoever sets `answered` first writes the slot's response,
+// the game thread once the task ran or the runner when the deadline passed.
+struct Ipc::Request
+{
+    int slot;
+    std::chrono::steady_clock::time_point deadline;
+    std::atomic<bool> answered { false };
+    std::vector<uint8_t> frame;     // copy of the request, the task turns it into the response
+};
 
-            if ((call->argc * sizeof(uintptr_t)) > sizeof(CallFunctionMessage::argv))
-            {
-                utils::log("[Ipc::handle_message] argc too big {x}\n", static_cast<int>(m_shared->type));
-                result->error = true;
-                result->type = MessageType::RESULT;
-                break;
-            }
+void Ipc::dispatch(int slot, MessageHeader *message, Task task, std::chrono::milliseconds timeout)
+{
+    auto *bytes = reinterpret_cast<uint8_t *>(message);
 
-            auto res = Darkorbit::get().call_sync([call] {
-                return call->object->call_method(call->index, call->argc, call->argv);
-            });
+    auto request = std::make_shared<Request>();
+    request->slot = slot;
+    request->deadline = std::chrono::steady_clock::now() + timeout;
+    request->frame.assign(bytes, bytes + message->size);
+    m_in_flight.push_back(request);
 
-            if (res.wait_for(5000ms) != std::future_status::ready)
-            {
-                result->error = true;
-                result->type = MessageType::RESULT;
-            }
-            else
-            {
-                auto value = res.get();
-                result->type = MessageType::RESULT;
-                result->error = false;
-                result->value = value;
-            }
-            break;
+    ShmRing *ring = m_ring;
+    Darkorbit::get().call_sync([ring, request, task]
+    {
+        // The client was already told it failed, don't act on it anymore
+        if (request->answered)
+        {
+            return 0;
         }
-        case MessageType::SEND_NOTIFICATION:
+
+        uint64_t started = ShmRing::Now();
+        task(request->frame);
+
+        // Timed out while it ran, the slot may hold another request by now
+        if (request->answered.exchange(true))
         {
-            auto *msg = reinterpret_cast<SendNotificationMessage *>(m_shared);
-            std::string name = msg->name;
+            return 0;
+        }
 
-            if (static_cast<size_t>(msg->argc) > sizeof(msg->argv) / sizeof(msg->argv[0]))
-            {
-                utils::log("[Ipc::handle_message] argc too big {x}\n", static_cast<int>(m_shared->type));
-                result->error = true;
-                result->type = MessageType::RESULT;
-                break;
-            }
+        auto *response = reinterpret_cast<MessageHeader *>(request->frame.data());
+        std::memcpy(ring->At(request->slot).arena, response, std::min<size_t>(response->size, request->frame.size()));
+        ring->At(request->slot).timing.started = started;
+        ring->Complete(request->slot);
+        return 0;
+    });
+}
 
-            std::vector<uintptr_t> args(&msg->argv[0], &msg->argv[msg->argc]);
+std::chrono::steady_clock::time_point Ipc::expire_requests()
+{
+    auto now = std::chrono::steady_clock::now();
+    auto next = now + 1s;
 
-            auto res = Darkorbit::get().call_sync([name, args] ()
-            {
-                return Darkorbit::get().send_notification(name, args);
-            });
+    for (auto it = m_in_flight.begin(); it != m_in_flight.end(); )
+    {
+        auto &request = **it;
+        if (now >= request.deadline && !request.answered.exchange(true))
+        {
+            auto *message = reinterpret_cast<MessageHeader *>(m_ring->At(request.slot).arena);
+            utils::log("[Ipc::expire_requests] {x} timed out\n", static_cast<int>(message->type));
+            fail(message);
+            m_ring->Complete(request.slot);
+        }
 
-            if (res.wait_for(5000ms) != std::future_status::ready)
-            {
-                result->error = true;
-                result->type = MessageType::RESULT;
-            }
-            break;
+        if (request.answered)
+        {
+            it = m_in_flight.erase(it);
+            continue;
         }
+        next = std::min(next, request.deadline);
+        ++it;
+    }
+    return next;
+}
+
+bool Ipc::handle_message(int slot, MessageHeader *message)
+{
+    switch (message->type)
+    {
+        case MessageType::CALL:
+        case MessageType::SEND_NOTIFICATION:
         case MessageType::USE_ITEM:
+        case MessageType::REFINE:
+        case MessageType::KEY_CLICK:
+        case MessageType::MOUSE_CLICK:
+        case MessageType::CHECK_SIGNATURE:
         {
-            auto *msg = reinterpret_cast<UseItemMessage *>(m_shared);
-            std::string name = msg->name;
-
-            auto res = Darkorbit::get().call_sync([name] ()
-            {
-                return Darkorbit::get().use_item(name, 0, 1);
-            });
-
-            if (res.wait_for(5000ms) != std::future_status::ready)
+            dispatch(slot, message, [] (std::vector<uint8_t> &frame)
             {
-                result->error = true;
-                result->type = MessageType::RESULT;
-            }
-            break;
+                run_game_command(reinterpret_cast<MessageHeader *>(frame.data()));
+            }, 5000ms);
+            return false;
         }
-        case MessageType::REFINE:
+        case MessageType::BATCH:
         {
-            auto *msg = reinterpret_cast<RefineMessage *>(m_shared);
-            auto res = Darkorbit::get().call_sync([ore=msg->ore, amount=msg->amount]
-            {
-                return Darkorbit::get().refine_ore(ore, amount);
-            });
+            auto *msg = reinterpret_cast<BatchMessage *>(message);
+            auto *frames = tail<uint8_t>(msg);
+            size_t size = tail_size(msg);
 
-            if (res.wait_for(5000ms) != std::future_status::ready)
+            msg->executed = 0;
+            if (msg->count > MAX_BATCH_COMMANDS)
             {
-                result->error = true;
-                result->type = MessageType::RESULT;
+                utils::log("[Ipc::handle_message] Batch too big {}\n", msg->count);
+                return true;
             }
 
-            break;
-        }
-        case MessageType::KEY_CLICK:
-        {
-            auto *msg = reinterpret_cast<KeyClickMessage *>(m_shared);
-            auto res = Darkorbit::get().call_sync([key=msg->key]
+            // Worked out up front, a response can be shorter than the frame it's written over
+            std::vector<uint32_t> offsets;
+            size_t offset = 0;
+            for (uint32_t i = 0; i < msg->count; i++)
             {
-                return Darkorbit::get().key_click(key);
-            });
+                auto *frame = reinterpret_cast<MessageHeader *>(frames + offset);
+                if (offset > size || !valid_frame(frame, size - offset))
+                {
+                    break;
+                }
+                offsets.push_back(offset);
+                offset += frame_size(frame->size);
+            }
 
-            if (res.wait_for(5000ms) != std::future_status::ready)
+            if (offsets.size() != msg->count)
             {
-                result->error = true;
-                result->type = MessageType::RESULT;
+                utils::log("[Ipc::handle_message] Invalid frame {} in batch\n", offsets.size());
+                return true;
             }
 
-            break;
+            dispatch(slot, message, [offsets] (std::vector<uint8_t> &frame)
+            {
+                auto *batch = reinterpret_cast<BatchMessage *>(frame.data());
+                for (auto offset : offsets)
+                {
+                    run_game_command(reinterpret_cast<MessageHeader *>(tail<uint8_t>(batch) + offset));
+                }
+                batch->executed = offsets.size();
+            }, 5000ms);
+            return false;
         }
-        case MessageType::MOUSE_CLICK:
+        case MessageType::SCAN:
         {
-            auto *msg = reinterpret_cast<MouseClickMessage *>(m_shared);
-            auto res = Darkorbit::get().call_sync([msg]
-            {
-                return Darkorbit::get().mouse_click(msg->x, msg->y, msg->button);
-            });
+            // Runs on the scan thread, the game thread is never involved and the requests
+            // behind it don't wait for a scan that can take seconds
+            auto *msg = reinterpret_cast<ScanMessage *>(message);
 
-            if (res.wait_for(5000ms) != std::future_status::ready)
+            if (msg->size == 0 || msg->size * 2ULL > tail_size(msg))
             {
-                result->error = true;
-                result->type = MessageType::RESULT;
+                utils::log("[Ipc::handle_message] Invalid scan size {}\n", msg->size);
+                msg->found = 0;
+                return true;
             }
 
-            break;
+            {
+                std::scoped_lock lk { m_scans_mut };
+                m_scans.push_back(slot);
+            }
+            m_scans_cv.notify_one();
+            return false;
         }
-        case MessageType::CHECK_SIGNATURE:
+        case MessageType::INSTANCES:
         {
-            auto *sig_result = reinterpret_cast<CheckSignatureMessage *>(m_shared);
-            auto *msg = reinterpret_cast<CheckSignatureMessage *>(m_shared);
+            auto *msg = reinterpret_cast<InstancesMessage *>(message);
 
-
-            auto res = Darkorbit::get().call_sync([msg]
+            msg->found = 0;
+            if (msg->name_length > tail_size(msg))
             {
-                return Darkorbit::get().check_method_signature(msg->object, msg->index, msg->method_name, msg->signature);
-            });
+                utils::log("[Ipc::handle_message] Invalid class name length {}\n", msg->name_length);
+                return true;
+            }
 
+            std::string class_name(tail<const char>(msg), msg->name_length);
+            size_t max = std::min<size_t>(msg->max_results, MAX_INSTANCES);
 
-            if (res.wait_for(5000ms) == std::future_status::ready)
-            {
-                sig_result->result = res.get();
-            }
-            else
+            // The heap can't change under us while the game thread is busy walking it
+            dispatch(slot, message, [class_name, max] (std::vector<uint8_t> &frame)
             {
-                utils::log("[Ipc::handle_message] Signature check timed out");
-                sig_result->result = -1;
-            }
+                auto instances = Darkorbit::get().find_instances(class_name, max);
+
+                frame.resize(sizeof(InstancesMessage) + instances.size() * sizeof(uintptr_t));
+                auto *msg = reinterpret_cast<InstancesMessage *>(frame.data());
+                msg->found = instances.size();
+                msg->header.size = frame.size();
+                std::memcpy(tail<uintptr_t>(msg), instances.data(), instances.size() * sizeof(uintptr_t));
+            }, 10000ms);
+            return false;
+        }
+        case MessageType::CENSUS:
+        {
+            reinterpret_cast<CensusMessage *>(message)->found = 0;
 
-            break;
+            dispatch(slot, message, [] (std::vector<uint8_t> &frame)
+            {
+                std::unordered_map<avm::Traits *, size_t> counts;
+                Darkorbit::get().find_instances("", 0, &counts);
+
+                std::vector<std::pair<std::string, size_t>> census;
+                for (auto &[traits, count] : counts)
+                {
+                    census.emplace_back(traits->name(), count);
+                }
+
+                std::sort(census.begin(), census.end(), [] (auto &a, auto &b) { return a.second > b.second; });
+                census.resize(std::min(census.size(), MAX_CENSUS_ENTRIES));
+
+                frame.resize(sizeof(CensusMessage) + census.size() * sizeof(CensusEntry));
+                auto *msg = reinterpret_cast<CensusMessage *>(frame.data());
+                auto *results = tail<CensusEntry>(msg);
+
+                for (auto &[name, count] : census)
+                {
+                    CensusEntry &entry = results[msg->found++];
+                    entry.count = count;
+                    std::strncpy(entry.name, name.c_str(), sizeof(entry.name) - 1);
+                    entry.name[sizeof(entry.name) - 1] = 0;
+                }
+                msg->header.size = frame.size();
+            }, 10000ms);
+            return false;
         }
         default:
-            utils::log("[Ipc::handle_message] Unknown ipc message type {x}\n", static_cast<int>(m_shared->type));
-            break;
+            utils::log("[Ipc::handle_message] Unknown ipc message type {x}\n", static_cast<int>(message->type));
+            message->error = 1;
+            return true;
     }
 }
 
 void Ipc::runner()
 {
-    struct sembuf sop[2];
-
     while (m_running)
     {
-        sop[0] = { .sem_num=0, .sem_op=0, .sem_flg=0 };
-        sop[1] = { .sem_num=1, .sem_op=1, .sem_flg=0 };
-        if (semop(m_sem, sop, 2) == -1)
+        // Wakes up in time to answer whatever the game thread doesn't finish before its deadline
+        int slot = m_ring->Take(expire_requests());
+        if (slot < 0)
         {
-            if (errno == EINTR)
+            continue;
+        }
+
+        // Game commands overwrite it once the game thread gets to them
+        m_ring->At(slot).timing.started = ShmRing::Now();
+
+        auto *message = reinterpret_cast<MessageHeader *>(m_ring->At(slot).arena);
+        if (!valid_frame(message, SHM_ARENA_SIZE))
+        {
+            utils::log("[Ipc::runner] Invalid frame, type {x} size {}\n", static_cast<int>(message->type), message->size);
+            message->error = 1;
+            m_ring->Complete(slot);
+        }
+        else if (handle_message(slot, message))
+        {
+            m_ring->Complete(slot);
+        }
+    }
+
+    // Nobody would time these out anymore
+    for (auto &request : m_in_flight)
+    {
+        if (!request->answered.exchange(true))
+        {
+            fail(reinterpret_cast<MessageHeader *>(m_ring->At(request->slot).arena));
+            m_ring->Complete(request->slot);
+        }
+    }
+    m_in_flight.clear();
+
+    utils::log("[Ipc::runner] Stopped\n");
+}
+
+void Ipc::scanner()
+{
+    while (true)
+    {
+        int slot;
+        {
+            std::unique_lock lk { m_scans_mut };
+            m_scans_cv.wait(lk, [this] { return m_cancel_scans || !m_scans.empty(); });
+            if (m_scans.empty())
             {
-                continue;
+                break;
             }
-            utils::log("[Ipc::runner] semop1 failed {}\n", strerror(errno));
-            m_running = false;
-            break;
+            slot = m_scans.front();
+            m_scans.pop_front();
         }
 
-        handle_message();
+        m_ring->At(slot).timing.started = ShmRing::Now();
 
-        sop[0] = { .sem_num=0, .sem_op= 1, .sem_flg=0 };
-        sop[1] = { .sem_num=1, .sem_op=-1, .sem_flg=0 };
-        if (semop(m_sem, sop, 2) == -1)
+        // Checked by the runner before it was queued
+        auto *msg = reinterpret_cast<ScanMessage *>(m_ring->At(slot).arena);
+        msg->area[sizeof(msg->area) - 1] = 0;
+
+        // The pattern keeps its own copy, hits can go over the query
+        auto *query = tail<const uint8_t>(msg);
+        CompiledPattern pattern(query, reinterpret_cast<const char *>(query + msg->size), msg->size);
+
+        msg->found = memory::query_memory(pattern, msg->alignment, tail<uintptr_t>(msg),
+                std::min<size_t>(msg->max_results, MAX_SCAN_RESULTS), msg->area, &m_cancel_scans);
+        msg->header.size = sizeof(ScanMessage) + msg->found * sizeof(uintptr_t);
+
+        if (m_cancel_scans)
         {
-            utils::log("[Ipc::runner] semop2 failed {}\n", strerror(errno));
-            m_running = false;
-            break;
+            // Partial results would look like a complete scan that found less
+            msg->found = 0;
+            msg->header.size = sizeof(ScanMessage);
+            fail(&msg->header);
         }
+        m_ring->Complete(slot);
     }
-    utils::log("[Ipc::runner] Stopped\n");
+
+    utils::log("[Ipc::scanner] Stopped\n");
 }
 
 Ipc::~Ipc()
@@ -1,11 +1,24 @@
 #ifndef IPC_H
 #define IPC_H
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <thread>
 
+#include "event_ring.h"
+#include "state_mirror.h"
 
-union Message;
+
+struct MessageHeader;
+struct SharedSegment;
+class ShmRing;
 
 class Ipc
 {
@@ -19,20 +32,55 @@ public:
     void Run()
     {
         m_running = true;
+        m_cancel_scans = false;
         m_runner_thread = std::thread(&Ipc::runner, this);
+        m_scan_thread = std::thread(&Ipc::scanner, this);
     }
 
     void Remove();
 
+    // Whether the client asked for events of this type, worth checking before gathering one
+    inline bool WantsEvent(EventType type) const
+    {
+        EventRing *events = m_events.load(std::memory_order_acquire);
+        return events && events->Wants(type);
+    }
+
+    // Safe from any thread, dropped if nobody listens for the type or the client is behind
+    void PostEvent(EventType type, uint32_t id = 0, uint64_t value = 0);
+
+    // Game state page the client reads without asking, nullptr before Init and after Remove
+    inline StateMirror *Mirror() const { return m_mirror; }
+
     ~Ipc();
 private:
-    void handle_message();
+    struct Request;
+
+    // Game thread work for one request, turns the copy of its frame into the response
+    typedef std::function<void(std::vector<uint8_t> &frame)> Task;
+
+    // Returns false if the request went to the game thread, which answers it later
+    bool handle_message(int slot, MessageHeader *message);
+    void dispatch(int slot, MessageHeader *message, Task task, std::chrono::milliseconds timeout);
+    // Fails requests that are past their deadline, returns when the next one is due
+    std::chrono::steady_clock::time_point expire_requests();
     void runner();
+    // Answers SCAN requests the runner queued, one at a time
+    void scanner();
 
     std::thread m_runner_thread;
+    std::thread m_scan_thread;
+    std::mutex m_scans_mut;
+    std::condition_variable m_scans_cv;
+    std::deque<int> m_scans;                // slots of SCAN requests waiting for the scan thread
+    std::atomic<bool> m_cancel_scans { false };
     int m_shmid;
-    int m_sem;
-    Message *m_shared = nullptr;
+    SharedSegment *m_segment = nullptr;
+    ShmRing *m_ring = nullptr;
+    std::atomic<EventRing *> m_events { nullptr };
+    StateMirror *m_mirror = nullptr;
+    std::mutex m_events_mut;    // hooks can fire on more than one thread, the ring takes one producer. Held to push and to change m_events.
+    std::vector<std::shared_ptr<Request>> m_in_flight;     // runner thread only
     bool m_running = false;
 };
 
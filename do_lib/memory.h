@@ -1,9 +1,13 @@
 #ifndef MEMORY_H
 #define MEMORY_H
+#include <atomic>
 #include <string>
 #include <cstdint>
+#include <utility>
 #include <vector>
 
+#include "compiled_pattern.h"
+
 namespace memory
 {
     struct MemPage
@@ -38,7 +42,47 @@ namespace memory
         return query_memory(query, mask.c_str(), alignment);
     }
 
-    uintptr_t find_pattern(const std::string &query, const std::string &segment);
+    // Every match up to max. Skips the region holding `out` so a result buffer in shared memory
+    // doesn't match itself. Memory is copied out chunk by chunk rather than read in place, so a
+    // region unmapped while the scan runs is skipped instead of crashing flash. Stops early once
+    // `cancel` is set. Returns the amount written to out.
+    size_t query_memory(const CompiledPattern &pattern, uint32_t alignment, uintptr_t *out, size_t max,
+            const std::string &area = "", const std::atomic<bool> *cancel = nullptr);
+
+    // First match in the mappings whose name contains `segment`, data included. With code_only
+    // only the .text of the loaded module of that name is searched, see find_signature.
+    uintptr_t find_pattern(const std::string &query, const std::string &segment, bool code_only = false);
+
+    struct Module
+    {
+        std::string path;
+        uintptr_t base = 0;
+        // [start, end) of .text, or of every executable segment if the section headers can't be read
+        std::vector<std::pair<uintptr_t, uintptr_t>> code;
+
+        bool contains_code(uintptr_t address) const
+        {
+            for (auto &[start, end] : code)
+            {
+                if (address >= start && address < end)
+                {
+                    return true;
+                }
+            }
+            return false;
+        }
+    };
+
+    // Loaded module whose path contains `name`, its headers are parsed once and cached
+    const Module *get_module(const std::string &name);
+
+    // First match inside the code of `module`, 0 if there is none. Heap pages are never touched.
+    uintptr_t find_signature(const CompiledPattern &pattern, const std::string &module = "libpepflashplayer");
+
+    inline uintptr_t find_signature(const std::string &query, const std::string &module = "libpepflashplayer")
+    {
+        return find_signature(CompiledPattern(query), module);
+    }
 
     std::vector<MemPage> get_pages(const std::string &name = "");
 
@@ -1,14 +1,24 @@
 #include "memory.h"
+#include <algorithm>
 #include <cstring>
 #include <cstdio>
+#include <fcntl.h>
+#include <link.h>
 #include <sys/mman.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include <time.h>
 #include <sstream>
 #include <iostream>
+#include <mutex>
+#include <unordered_map>
 
+#include "maps_parser.h"
 #include "utils.h"
 
+// Bytes read per process_vm_readv while scanning
+#define SCAN_CHUNK_SIZE (1024 * 1024)
+
 
 int memory:: unprotect(uint64_t address)
 {
@@ -19,30 +29,21 @@ int memory:: unprotect(uint64_t address)
 
 std::vector<memory::MemPage> memory::get_pages(const std::string &name)
 {
+    thread_local MapsParser parser;
     std::vector<MemPage> pages;
-    if (std::ifstream maps_f { "/proc/self/maps" })
+
+    if (parser.Load(0))
     {
-        std::string line;
-        while (std::getline(maps_f, line))
+        for (auto &region : parser.Regions())
         {
-            std::stringstream ss(line);
-
-            uintptr_t start, end, offset, dev_major, dev_minor, inode;
-            char skip, r, w, x, c;
-            std::string path_name;
-
-            ss >> std::hex >> start >> skip >> end >>
-                r >> w >> x >> c >>
-                offset >> dev_major >>
-                skip >> dev_minor >> 
-                inode >> path_name;
-
-            if (!name.empty() && path_name.find(name) == std::string::npos)
+            if (!name.empty() && region.name.find(name) == std::string_view::npos)
             {
                 continue;
             }
 
-            pages.emplace_back(start, end, r, w, x, c, offset, 0, path_name);
+            pages.emplace_back(region.start, region.end,
+                    region.read, region.write, region.exec, region.cow,
+                    region.offset, 0, std::string(region.name));
         }
     }
     return pages;
@@ -88,8 +89,230 @@ uintptr_t memory::query_memory(uint8_t *query, const char *mask, uint32_t alignm
     return 0ULL;
 }
 
-uintptr_t memory::find_pattern(const std::string &query, const std::string &segment)
+// Copies our own memory without touching it, a page that was unmapped or made unreadable since
+// the maps were read fails the call instead of raising SIGSEGV. Returns the bytes copied.
+static ssize_t read_self(uintptr_t address, uint8_t *buf, size_t size)
+{
+    static const pid_t self = getpid();
+
+    iovec local { buf, size };
+    iovec remote { reinterpret_cast<void *>(address), size };
+    return process_vm_readv(self, &local, 1, &remote, 1, 0);
+}
+
+size_t memory::query_memory(const CompiledPattern &pattern, uint32_t alignment, uintptr_t *out, size_t max,
+        const std::string &area, const std::atomic<bool> *cancel)
+{
+    size_t found = 0;
+
+    if (!pattern.Valid() || !max)
+    {
+        return 0;
+    }
+
+    const uintptr_t page_size = sysconf(_SC_PAGESIZE);
+    alignment = alignment ? alignment : 1;
+
+    // The last pattern size - 1 bytes of a chunk are kept in front of the next one, for matches across chunks
+    const size_t keep = pattern.Size() - 1;
+    std::vector<uint8_t> buf(keep + SCAN_CHUNK_SIZE);
+    const uintptr_t buf_start = reinterpret_cast<uintptr_t>(buf.data());
+
+    for (auto &region : get_pages(area))
+    {
+        if (pattern.Size() > region.end - region.start
+            || (uintptr_t(out) >= region.start && uintptr_t(out) < region.end)
+            || region.read == '-'
+            || region.name == "[vvar]"
+        )
+        {
+            continue;
+        }
+
+        size_t carried = 0;
+        uintptr_t slow_until = 0;   // a chunk failed, go page by page up to here
+
+        for (uintptr_t pos = region.start; pos < region.end; )
+        {
+            if (cancel && *cancel)
+            {
+                return found;
+            }
+
+            size_t size = pos < slow_until ? page_size - (pos & (page_size - 1)) : SCAN_CHUNK_SIZE;
+            size = std::min<size_t>(size, region.end - pos);
+
+            ssize_t bytes_read = read_self(pos, buf.data() + carried, size);
+            if (bytes_read <= 0)
+            {
+                if (pos >= slow_until && size > page_size)
+                {
+                    slow_until = pos + size;
+                }
+                else
+                {
+                    // This page is gone, a match can't span it
+                    carried = 0;
+                    pos = (pos & ~(page_size - 1)) + page_size;
+                }
+                continue;
+            }
+
+            size_t total = carried + bytes_read;
+            uintptr_t base = pos - carried;
+
+            bool more = pattern.FindAll(buf.data(), total, 1, [&] (size_t offset)
+            {
+                uintptr_t address = base + offset;
+                // The compiled pattern's own copy of the bytes and the copies in our buffer
+                if (address % alignment == 0 && address != reinterpret_cast<uintptr_t>(pattern.Data())
+                    && (address < buf_start || address >= buf_start + buf.size()))
+                {
+                    out[found++] = address;
+                }
+                return found < max;
+            });
+
+            if (!more)
+            {
+                return found;
+            }
+
+            carried = std::min(keep, total);
+            std::memmove(buf.data(), buf.data() + total - carried, carried);
+            pos += bytes_read;
+        }
+    }
+
+    return found;
+}
+
+// Bounds of .text from the section headers on disk, those aren't mapped at runtime
+static bool read_text_section(const std::string &path, uintptr_t base, std::pair<uintptr_t, uintptr_t> &text)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+    {
+        return false;
+    }
+
+    bool found = false;
+    ElfW(Ehdr) ehdr;
+
+    if (pread(fd, &ehdr, sizeof(ehdr), 0) == sizeof(ehdr)
+        && memcmp(ehdr.e_ident, ELFMAG, SELFMAG) == 0
+        && ehdr.e_shentsize == sizeof(ElfW(Shdr))
+        && ehdr.e_shstrndx < ehdr.e_shnum)
+    {
+        std::vector<ElfW(Shdr)> sections(ehdr.e_shnum);
+        ssize_t want = sections.size() * sizeof(ElfW(Shdr));
+
+        if (pread(fd, sections.data(), want, ehdr.e_shoff) == want)
+        {
+            auto &strtab = sections[ehdr.e_shstrndx];
+            std::vector<char> names(strtab.sh_size + 1, 0);
+
+            if (pread(fd, names.data(), strtab.sh_size, strtab.sh_offset) == static_cast<ssize_t>(strtab.sh_size))
+            {
+                for (auto &section : sections)
+                {
+                    if (section.sh_name < strtab.sh_size && strcmp(&names[section.sh_name], ".text") == 0)
+                    {
+                        text = { base + section.sh_addr, base + section.sh_addr + section.sh_size };
+                        found = true;
+                        break;
+                    }
+                }
+            }
+        }
+    }
+
+    close(fd);
+    return found;
+}
+
+const memory::Module *memory::get_module(const std::string &name)
+{
+    static std::mutex modules_mut;
+    static std::unordered_map<std::string, Module> modules;
+
+    std::scoped_lock lk { modules_mut };
+
+    if (auto it = modules.find(name); it != modules.end())
+    {
+        return &it->second;
+    }
+
+    Module module;
+    std::pair<const std::string &, Module &> ctx { name, module };
+
+    // Program headers of loaded objects are mapped, no need to go through the maps file
+    dl_iterate_phdr([] (dl_phdr_info *info, size_t, void *data)
+    {
+        auto &[name, module] = *static_cast<std::pair<const std::string &, Module &> *>(data);
+
+        if (!info->dlpi_name || !strstr(info->dlpi_name, name.c_str()))
+        {
+            return 0;
+        }
+
+        module.path = info->dlpi_name;
+        module.base = info->dlpi_addr;
+
+        for (int i = 0; i < info->dlpi_phnum; i++)
+        {
+            auto &phdr = info->dlpi_phdr[i];
+            if (phdr.p_type == PT_LOAD && (phdr.p_flags & PF_X))
+            {
+                uintptr_t start = info->dlpi_addr + phdr.p_vaddr;
+                module.code.emplace_back(start, start + phdr.p_memsz);
+            }
+        }
+        return 1;
+    }, &ctx);
+
+    if (module.code.empty())
+    {
+        return nullptr;
+    }
+
+    std::pair<uintptr_t, uintptr_t> text;
+    if (read_text_section(module.path, module.base, text))
+    {
+        module.code = { text };
+    }
+
+    return &modules.emplace(name, std::move(module)).first->second;
+}
+
+uintptr_t memory::find_signature(const CompiledPattern &pattern, const std::string &module_name)
 {
+    const Module *module = get_module(module_name);
+
+    if (!module || !pattern.Valid())
+    {
+        utils::log("[memory::find_signature] No module {} or invalid pattern\n", module_name);
+        return 0;
+    }
+
+    for (auto &[start, end] : module->code)
+    {
+        size_t offset = pattern.Find(reinterpret_cast<const uint8_t *>(start), end - start, 0);
+        if (offset != CompiledPattern::npos)
+        {
+            return start + offset;
+        }
+    }
+    return 0;
+}
+
+uintptr_t memory::find_pattern(const std::string &query, const std::string &segment, bool code_only)
+{
+    if (code_only)
+    {
+        return find_signature(query, segment);
+    }
+
     std::stringstream ss(query);
     std::string data{ };
     std::string mask{ };